@@ -0,0 +1,148 @@
+#include "batch.hpp"
+#include "ways.hpp"
+#include "cache.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <pthread.h>
+#include <unistd.h>
+
+
+struct Batch::Pool {
+  const std::vector<Job> *jobs;
+  u32 next;  // Next job to take
+  u32 failures;
+  const Ways::Options *options;
+  const Cache *cache;
+  pthread_mutex_t mutex;
+};
+
+
+bool Batch::load(std::istream &in, std::vector<Job> &jobs) {
+    std::string line;
+    u32 lineNumber = 0;
+
+    while (std::getline(in, line)) {
+        lineNumber++;
+
+        std::istringstream fields(line);
+        Job job;
+        std::string extra;
+        if (!(fields >> job.input) || job.input[0] == '#') {
+            continue;
+        }
+        if (!(fields >> job.output) || fields >> extra) {
+            std::cerr << "error: expected input and output paths at line " << lineNumber << " of the batch list" << std::endl;
+            return false;
+        }
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+
+bool Batch::run(const std::vector<Job> &jobs, u32 threadCount, const Ways::Options &options, const Cache *cache) {
+    if (threadCount == 0) {
+        const long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = cpuCount > 0 ? cpuCount : 1;
+    }
+    if (threadCount > jobs.size()) {
+        threadCount = jobs.size();
+    }
+
+    Pool pool;
+    pool.jobs = &jobs;
+    pool.next = 0;
+    pool.failures = 0;
+    pool.options = &options;
+    pool.cache = cache;
+    pthread_mutex_init(&pool.mutex, 0);
+
+    std::vector<pthread_t> threads(threadCount);
+    std::vector<bool> started(threadCount, false);
+    for (u32 i = 1; i < threadCount; ++i) {
+        started[i] = pthread_create(&threads[i], 0, work, &pool) == 0;
+    }
+    work(&pool);
+    for (u32 i = 1; i < threadCount; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], 0);
+        }
+    }
+
+    pthread_mutex_destroy(&pool.mutex);
+
+    if (pool.failures > 0) {
+        std::cerr << "error: " << pool.failures << " of " << jobs.size() << " specification(s) failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+void *Batch::work(void *self) {
+    Pool &pool = *static_cast<Pool *>(self);
+
+    for (;;) {
+        pthread_mutex_lock(&pool.mutex);
+        const u32 jobId = pool.next;
+        if (jobId < pool.jobs->size()) {
+            pool.next++;
+        }
+        pthread_mutex_unlock(&pool.mutex);
+
+        if (jobId >= pool.jobs->size()) {
+            return 0;
+        }
+
+        const Job &job = (*pool.jobs)[jobId];
+        std::string diagnostics;
+        const bool success = translate(job, *pool.options, pool.cache, diagnostics);
+
+        // Diagnostics of a job are printed out at once, so they do not interleave
+        std::ostringstream report;
+        std::istringstream lines(diagnostics);
+        std::string line;
+        while (std::getline(lines, line)) {
+            report << job.input << ": " << line << std::endl;
+        }
+
+        pthread_mutex_lock(&pool.mutex);
+        std::cerr << report.str() << std::flush;
+        if (!success) {
+            pool.failures++;
+        }
+        pthread_mutex_unlock(&pool.mutex);
+    }
+}
+
+
+bool Batch::translate(const Job &job, const Ways::Options &options, const Cache *cache, std::string &diagnostics) {
+    std::ostringstream log;
+    std::ostringstream tables;
+    bool success = false;
+
+    std::ifstream in(job.input.c_str());
+    if (!in) {
+        log << "error: unable to open specification" << std::endl;
+    } else {
+        Ways::diagnostics(&log);
+        success = cache ? cache->translate(in, tables, options) : Ways::translate(in, tables, 0, options);
+        Ways::diagnostics(0);
+    }
+
+    if (success) {
+        std::ofstream out(job.output.c_str(), std::ios::binary);
+        const std::string text = tables.str();
+        out.write(text.data(), text.length());
+        out.close();
+        if (!out) {
+            log << "error: unable to write `" << job.output << '`' << std::endl;
+            success = false;
+        }
+    }
+
+    diagnostics = log.str();
+    return success;
+}
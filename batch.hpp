@@ -0,0 +1,49 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "ways.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <elib/aliases.hpp>
+using namespace elib::aliases;
+
+class Cache;
+
+/**
+ * Translates many specifications in one process, several at a time.
+**/
+class Batch {
+public:
+    struct Job {
+      std::string input;
+      std::string output;
+    };
+
+public:
+    /**
+     * Reads the list of jobs from @in: a pair of paths (input, output) per line.
+     *   Empty lines and lines starting with `#` are skipped.
+     * Returns true if succeeds or false if fails.
+    **/
+    static bool load(std::istream &in, std::vector<Job> &jobs);
+
+    /**
+     * Translates @jobs on @threadCount threads (0 for the number of processors).
+     *   Diagnostics of every job are printed out together, each line prefixed
+     * with the input path. The output of a failed job is not written.
+     *   Tables are emitted with @options and taken from (and stored into)
+     * @cache unless it is null.
+     * Returns true if all jobs succeed or false otherwise.
+    **/
+    static bool run(const std::vector<Job> &jobs, u32 threadCount, const Ways::Options &options = Ways::Options(), const Cache *cache = 0);
+
+private:
+    struct Pool;
+
+    static void *work(void *pool);
+    static bool translate(const Job &job, const Ways::Options &options, const Cache *cache, std::string &diagnostics);
+};
+
+#endif // BATCH_HPP
@@ -0,0 +1,58 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "ways.hpp"
+
+#include <string>
+#include <elib/aliases.hpp>
+using namespace elib::aliases;
+
+namespace bench {
+  const u64 DEFAULT_CORPUS_SIZE = 16 << 20;  // In bytes
+  const u64 DEFAULT_SEED = 1;
+
+  /**
+   * Counts what the runtime lexer produces
+  **/
+  struct Counter {
+    Counter() : tokens(0), failures(0) {}
+
+    void token(u32, u64, const char *, u32) { tokens++; }
+    void failure(u32, u64) { failures++; }
+
+    u64 tokens;
+    u64 failures;
+  };
+
+  /**
+   * Builds @automaton from the specification file @path.
+   * Returns true if succeeds or false if fails.
+  **/
+  bool load(const std::string &path, Ways::Automaton &automaton);
+
+  /**
+   * Returns the monotonic time in seconds
+  **/
+  double now();
+
+  /**
+   * Drops the file @path from the page cache so the next read of it is cold.
+   * Returns true if succeeds or false if fails.
+  **/
+  bool evict(const std::string &path);
+
+  /**
+   * Generates (stores into @corpus) a synthetic input of about @size bytes
+   *   for @automaton, the same one for the same @seed.
+   * Returns true if the whole corpus lexes or false if the walk got stuck.
+  **/
+  bool generate(const Ways::Automaton &automaton, u64 size, u64 seed, std::string &corpus);
+
+  int prefetch(int argc, char **argv);
+  int files(int argc, char **argv);
+  int replay(int argc, char **argv);
+  int corpus(int argc, char **argv);
+  int suite(int argc, char **argv);
+}  // namespace bench
+
+#endif // BENCH_HPP
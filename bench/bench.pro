@@ -0,0 +1,21 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = bench
+
+INCLUDEPATH += .. ../include ../runtime
+LIBS += -lpthread
+
+# Shuffles of the classifier (see runtime/classifier.hpp)
+contains(QMAKE_HOST.arch, x86_64): QMAKE_CXXFLAGS += -mssse3
+
+SOURCES += main.cpp prefetch.cpp files.cpp replay.cpp corpus.cpp suite.cpp ../jit.cpp ../output.cpp ../ways.cpp ../runtime/input.cpp ../runtime/location.cpp ../runtime/stream.cpp
+HEADERS += bench.hpp ../jit.hpp ../runtime/boundary.hpp ../runtime/classifier.hpp ../runtime/generator.hpp ../runtime/lexer.hpp ../runtime/input.hpp ../runtime/location.hpp ../runtime/pipeline.hpp ../runtime/service.hpp ../runtime/stream.hpp ../runtime/symbols.hpp
+
+# `make suite` measures every specification of data/ into suite.json:
+#   compare the reports of two commits to see a regression
+suite.commands = $$OUT_PWD/$$TARGET suite --output=$$OUT_PWD/suite.json $$PWD/../data/*.fa
+suite.depends = $$OUT_PWD/$$TARGET
+QMAKE_EXTRA_TARGETS += suite
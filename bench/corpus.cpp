@@ -0,0 +1,152 @@
+#include "bench.hpp"
+#include "lexer.hpp"
+
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+
+/**
+ * Synthetic corpora: a random walk over the automaton of a specification.
+ *   Every character is drawn from the classes the current state accepts
+ * (after following the transitions which leave it), so the corpus lexes
+ * without failures and covers the tokens the specification may produce.
+ *   Characters are printable ASCII, tabs and newlines only: the corpus is
+ * valid for 8-bit and UTF-8 alphabets alike.
+**/
+namespace bench {
+  /**
+   * xorshift64*: the same sequence on every platform, unlike std::rand()
+  **/
+  class Random {
+  public:
+    explicit Random(u64 seed) : mState(seed != 0 ? seed : 0x9e3779b97f4a7c15ULL) {}
+
+    u64 next() {
+      mState ^= mState >> 12;
+      mState ^= mState << 25;
+      mState ^= mState >> 27;
+      return mState * 0x2545f4914f6cdd1dULL;
+    }
+
+    u32 below(u32 bound) { return u32(next() >> 32) % bound; }
+
+  private:
+    u64 mState;
+  };
+
+  /**
+   * Follows the transitions of @automaton from @stateId on @classId which
+   *   leave the character until one consumes it.
+   * Returns the state after the character or lexer::INVALID_ID if it fails.
+  **/
+  static u32 step(const Ways::Automaton &automaton, u32 stateId, u32 classId) {
+    for (u32 steps = 0; steps <= automaton.stateCount; ++steps) {
+      const Ways::Transition &transition = automaton.transition(stateId, classId);
+      if (transition.action == Ways::Transition::ActionInvalid || transition.action == Ways::Transition::ActionFailure || transition.action == Ways::Transition::ActionRecover) {
+        return lexer::INVALID_ID;
+      }
+      if (transition.mode != Ways::Transition::ModeLeave) {
+        return transition.state;
+      }
+      stateId = transition.state;
+    }
+    // The transitions leave the character forever
+    return lexer::INVALID_ID;
+  }
+
+  /**
+   * Returns true if the input may end in @stateId (see lexer::Lexer::finish())
+  **/
+  static bool ends(const Ways::Automaton &automaton, u32 stateId) {
+    for (u32 steps = 0; steps <= automaton.stateCount; ++steps) {
+      const Ways::Transition &transition = automaton.transition(stateId, automaton.eosClass());
+      if (transition.action == Ways::Transition::ActionInvalid || transition.action == Ways::Transition::ActionFailure || transition.action == Ways::Transition::ActionRecover) {
+        return false;
+      }
+      if (transition.mode != Ways::Transition::ModeLeave || transition.state == stateId) {
+        return true;
+      }
+      stateId = transition.state;
+    }
+    return false;
+  }
+
+  bool generate(const Ways::Automaton &automaton, u64 size, u64 seed, std::string &corpus) {
+    // A walk which cannot end goes on for this many more characters at most
+    const u64 OVERRUN_LIMIT = 1 << 16;
+
+    std::vector<std::string> members(automaton.classCount);
+    for (u32 c = 0; c < 128; ++c) {
+      if (c == '\t' || c == '\n' || (c >= ' ' && c < 127)) {
+        members[automaton.classOf(c)] += char(c);
+      }
+    }
+
+    // Per state: the classes it accepts and the states they lead to
+    std::vector<std::vector<u32> > classes(automaton.stateCount);
+    std::vector<std::vector<u32> > targets(automaton.stateCount);
+    std::vector<bool> final(automaton.stateCount);
+    for (u32 stateId = 0; stateId < automaton.stateCount; ++stateId) {
+      for (u32 classId = 0; classId < automaton.eosClass(); ++classId) {
+        const u32 target = members[classId].empty() ? lexer::INVALID_ID : step(automaton, stateId, classId);
+        if (target != lexer::INVALID_ID) {
+          classes[stateId].push_back(classId);
+          targets[stateId].push_back(target);
+        }
+      }
+      final[stateId] = ends(automaton, stateId);
+    }
+
+    Random random(seed);
+    u32 stateId = automaton.initialState();
+    std::vector<u32> choices;
+
+    corpus.clear();
+    corpus.reserve(size);
+    while (corpus.size() < size || !final[stateId]) {
+      if (classes[stateId].empty() || corpus.size() >= size + OVERRUN_LIMIT) {
+        break;
+      }
+
+      // Past the size, the walk heads for a state the input may end in
+      u32 choice = random.below(classes[stateId].size());
+      if (corpus.size() >= size) {
+        choices.clear();
+        for (u32 i = 0; i < targets[stateId].size(); ++i) {
+          if (final[targets[stateId][i]]) {
+            choices.push_back(i);
+          }
+        }
+        if (!choices.empty()) {
+          choice = choices[random.below(choices.size())];
+        }
+      }
+
+      const std::string &chars = members[classes[stateId][choice]];
+      corpus += chars[random.below(chars.size())];
+      stateId = targets[stateId][choice];
+    }
+
+    return final[stateId];
+  }
+
+  int corpus(int argc, char **argv) {
+    if (argc < 2) {
+      std::cerr << "usage: corpus <spec> <size> [seed]" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    Ways::Automaton automaton;
+    if (!load(argv[0], automaton)) {
+      return EXIT_FAILURE;
+    }
+
+    std::string text;
+    if (!generate(automaton, std::strtoull(argv[1], 0, 10), argc > 2 ? std::strtoull(argv[2], 0, 10) : DEFAULT_SEED, text)) {
+      std::cerr << "warning: the walk over `" << argv[0] << "` got stuck, the corpus does not lex completely" << std::endl;
+    }
+    std::cout.write(text.data(), text.size());
+
+    return std::cout.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+}  // namespace bench
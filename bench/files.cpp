@@ -0,0 +1,118 @@
+#include "bench.hpp"
+#include "service.hpp"
+#include "location.hpp"
+
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+
+/**
+ * Lexes a set of files with service::Service and reports:
+ *   the scaling with the number of threads (1, 2, 4, ... up to the cores),
+ *   the throughput per file size bucket (with all the cores).
+ * The files are read once beforehand, so the page cache is warm.
+**/
+namespace bench {
+  typedef service::Service<Ways::Automaton> Service;
+
+  static const u64 BUCKETS[] = {4 << 10, 64 << 10, 1 << 20, 16 << 20, u64(-1)};
+  static const char *BUCKET_NAMES[] = {"<4K", "<64K", "<1M", "<16M", ">=16M"};
+  static const u32 BUCKET_COUNT = sizeof(BUCKETS) / sizeof(BUCKETS[0]);
+
+  static bool runFiles(const Ways::Automaton &automaton, u32 threadCount, const std::vector<std::string> &paths, double &time, u64 &bytes, u64 &tokens, std::vector<service::Result> &results) {
+    Service service(automaton, threadCount);
+
+    const double start = now();
+    const bool success = service.run(paths, results);
+    time = now() - start;
+
+    bytes = tokens = 0;
+    for (u32 i = 0; i < results.size(); ++i) {
+      bytes += results[i].size;
+      tokens += results[i].tokenCount;
+    }
+    return success;
+  }
+
+  static bool runFiles(const Ways::Automaton &automaton, u32 threadCount, const std::vector<std::string> &paths, double &time, u64 &bytes, u64 &tokens) {
+    std::vector<service::Result> results;
+    return runFiles(automaton, threadCount, paths, time, bytes, tokens, results);
+  }
+
+  int files(int argc, char **argv) {
+    if (argc < 2) {
+      std::cerr << "usage: files <spec> <input>..." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    Ways::Automaton automaton;
+    if (!load(argv[0], automaton)) {
+      return EXIT_FAILURE;
+    }
+
+    const std::vector<std::string> paths(argv + 1, argv + argc);
+    const u32 coreCount = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    double time;
+    u64 bytes, tokens;
+
+    // Warm up the page cache and check the files
+    std::vector<service::Result> results;
+    if (!runFiles(automaton, coreCount, paths, time, bytes, tokens, results)) {
+      for (u32 i = 0; i < results.size(); ++i) {
+        if (results[i].ok) {
+          continue;
+        }
+        std::cerr << paths[i] << ": ";
+        if (results[i].failurePosition.line == 0) {
+          std::cerr << "error: unable to read the file" << std::endl;
+        } else {
+          location::report(std::cerr, automaton.failureMessages, results[i].failureId, results[i].failurePosition);
+        }
+      }
+      std::cerr << "warning: some files failed to lex" << std::endl;
+    }
+    u64 recoveries = 0;
+    for (u32 i = 0; i < results.size(); ++i) {
+      recoveries += results[i].recoveries.size();
+    }
+    if (recoveries > 0) {
+      std::cerr << "warning: lexing recovered from " << recoveries << " failures" << std::endl;
+    }
+
+    std::cout << "files: " << paths.size() << ", bytes: " << bytes << ", tokens: " << tokens << std::endl;
+    std::cout << "threads\ttime, s\tMB/s\tspeedup" << std::endl;
+    double baseTime = 0;
+    for (u32 threadCount = 1; ; threadCount = threadCount * 2 < coreCount ? threadCount * 2 : coreCount) {
+      runFiles(automaton, threadCount, paths, time, bytes, tokens);
+      if (threadCount == 1) {
+        baseTime = time;
+      }
+      std::cout << threadCount << '\t' << time << '\t' << bytes / time / 1e6 << '\t' << baseTime / time << std::endl;
+      if (threadCount == coreCount) {
+        break;
+      }
+    }
+
+    std::cout << "bucket\tfiles\tMB/s\tfiles/s" << std::endl;
+    std::vector<std::string> buckets[BUCKET_COUNT];
+    for (u32 i = 0; i < paths.size(); ++i) {
+      std::vector<std::string> path(1, paths[i]);
+      runFiles(automaton, 1, path, time, bytes, tokens);
+      u32 bucket = 0;
+      while (bytes >= BUCKETS[bucket]) {
+        bucket++;
+      }
+      buckets[bucket].push_back(paths[i]);
+    }
+    for (u32 bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+      if (buckets[bucket].empty()) {
+        continue;
+      }
+      runFiles(automaton, coreCount, buckets[bucket], time, bytes, tokens);
+      std::cout << BUCKET_NAMES[bucket] << '\t' << buckets[bucket].size() << '\t' << bytes / time / 1e6 << '\t' << buckets[bucket].size() / time << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+  }
+}  // namespace bench
@@ -0,0 +1,65 @@
+#include "bench.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace bench {
+  bool load(const std::string &path, Ways::Automaton &automaton) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+      std::cerr << "error: unable to open specification `" << path << '`' << std::endl;
+      return false;
+    }
+    return Ways::build(in, automaton);
+  }
+
+  double now() {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+  }
+
+  bool evict(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    const bool success = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return success;
+  }
+}  // namespace bench
+
+
+int main(int argc, char **argv) {
+  // Generator diagnostics are of no interest here
+  std::clog.rdbuf(0);
+
+  if (argc >= 2 && std::strcmp(argv[1], "prefetch") == 0) {
+    return bench::prefetch(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "files") == 0) {
+    return bench::files(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "replay") == 0) {
+    return bench::replay(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "corpus") == 0) {
+    return bench::corpus(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "suite") == 0) {
+    return bench::suite(argc - 2, argv + 2);
+  }
+
+  std::cerr << "usage: " << argv[0] << " prefetch <spec> <input> [block size]" << std::endl;
+  std::cerr << "       " << argv[0] << " files <spec> <input>..." << std::endl;
+  std::cerr << "       " << argv[0] << " replay <spec> <input> <stream>" << std::endl;
+  std::cerr << "       " << argv[0] << " corpus <spec> <size> [seed]" << std::endl;
+  std::cerr << "       " << argv[0] << " suite [--size=<bytes>] [--seed=<n>] [--repeat=<n>] [--output=<report>] <spec>..." << std::endl;
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,121 @@
+#include "bench.hpp"
+#include "lexer.hpp"
+#include "input.hpp"
+
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Lexes a cold-cache file three ways:
+ *   read: only reads the file (the I/O cost),
+ *   sync: reads a block, lexes it, reads the next one and so on,
+ *   prefetch: lexes blocks handed out by input::Prefetcher.
+ * With a perfect overlap `prefetch` takes max(read, lexing) instead of their sum.
+**/
+namespace bench {
+  typedef lexer::Lexer<Ways::Automaton, Counter> Lexer;
+
+  static bool runRead(const std::string &path, u32 blockSize, double &time) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    std::vector<char> block(blockSize);
+    const double start = now();
+    while (read(fd, &block[0], blockSize) > 0) {
+    }
+    time = now() - start;
+
+    close(fd);
+    return true;
+  }
+
+  static bool runSync(const std::string &path, const Ways::Automaton &automaton, u32 blockSize, double &time, Counter &counter) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    Lexer lexer(automaton, counter);
+    std::vector<char> block(blockSize);
+    ssize_t length;
+    const double start = now();
+    while ((length = read(fd, &block[0], blockSize)) > 0 && lexer.feed(&block[0], length)) {
+    }
+    lexer.finish();
+    time = now() - start;
+
+    close(fd);
+    return true;
+  }
+
+  static bool runPrefetch(const std::string &path, const Ways::Automaton &automaton, u32 blockSize, double &time, Counter &counter) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    Lexer lexer(automaton, counter);
+    const double start = now();
+    {
+      input::Prefetcher prefetcher(fd, blockSize);
+      const char *data;
+      u32 length;
+      while (prefetcher.next(data, length) && lexer.feed(data, length)) {
+      }
+    }
+    lexer.finish();
+    time = now() - start;
+
+    close(fd);
+    return true;
+  }
+
+  int prefetch(int argc, char **argv) {
+    if (argc < 2) {
+      std::cerr << "usage: prefetch <spec> <input> [block size]" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    const std::string input = argv[1];
+    const u32 blockSize = argc > 2 ? std::strtoul(argv[2], 0, 10) : input::Prefetcher::DEFAULT_BLOCK_SIZE;
+
+    Ways::Automaton automaton;
+    if (!load(argv[0], automaton)) {
+      return EXIT_FAILURE;
+    }
+
+    double readTime = 0, syncTime = 0, prefetchTime = 0;
+    Counter syncCounter, prefetchCounter;
+
+    bool cold = evict(input);
+    if (!runRead(input, blockSize, readTime)) {
+      std::cerr << "error: unable to read `" << input << '`' << std::endl;
+      return EXIT_FAILURE;
+    }
+    cold = evict(input) && cold;
+    runSync(input, automaton, blockSize, syncTime, syncCounter);
+    cold = evict(input) && cold;
+    runPrefetch(input, automaton, blockSize, prefetchTime, prefetchCounter);
+
+    if (!cold) {
+      std::cerr << "warning: unable to evict `" << input << "` from the page cache, timings are warm" << std::endl;
+    }
+    if (syncCounter.tokens != prefetchCounter.tokens || syncCounter.failures != prefetchCounter.failures) {
+      std::cerr << "error: token streams differ" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << "tokens:   " << syncCounter.tokens << std::endl;
+    std::cout << "read:     " << readTime << " s" << std::endl;
+    std::cout << "sync:     " << syncTime << " s" << std::endl;
+    std::cout << "prefetch: " << prefetchTime << " s" << std::endl;
+    std::cout << "overlap:  " << (syncTime - prefetchTime) << " s of " << readTime << " s of I/O hidden" << std::endl;
+
+    return EXIT_SUCCESS;
+  }
+}  // namespace bench
@@ -0,0 +1,75 @@
+#include "bench.hpp"
+#include "lexer.hpp"
+#include "stream.hpp"
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <cstdlib>
+
+/**
+ * Compares lexing an input (from memory) with replaying its token stream
+ *   (see runtime/stream.hpp) written to @stream path.
+**/
+namespace bench {
+  int replay(int argc, char **argv) {
+    if (argc < 3) {
+      std::cerr << "usage: replay <spec> <input> <stream>" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    Ways::Automaton automaton;
+    if (!load(argv[0], automaton)) {
+      return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    const std::vector<char> input((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    Counter counter;
+    lexer::Lexer<Ways::Automaton, Counter> counting(automaton, counter);
+    double start = now();
+    counting.feed(&input[0], input.size());
+    counting.finish();
+    const double lexTime = now() - start;
+
+    {
+      std::ofstream out(argv[2], std::ios::binary);
+      stream::Writer writer(out);
+      lexer::Lexer<Ways::Automaton, stream::Writer> writing(automaton, writer);
+      writing.feed(&input[0], input.size());
+      writing.finish();
+      if (!writer.close()) {
+        std::cerr << "error: unable to write `" << argv[2] << '`' << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    stream::Reader reader;
+    if (!reader.open(argv[2])) {
+      std::cerr << "error: unable to read `" << argv[2] << '`' << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::vector<stream::Token> tokens(4096);
+    u64 replayed = 0;
+    start = now();
+    for (u32 count; (count = reader.read(&tokens[0], tokens.size())) > 0; ) {
+      replayed += count;
+    }
+    const double replayTime = now() - start;
+
+    if (replayed != counter.tokens) {
+      std::cerr << "error: " << replayed << " token(s) replayed of " << counter.tokens << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::ifstream written(argv[2], std::ios::binary | std::ios::ate);
+    std::cout << "tokens: " << counter.tokens << ", input: " << input.size() << " bytes, stream: " << u64(written.tellg()) << " bytes" << std::endl;
+    std::cout << "lex:    " << lexTime << " s" << std::endl;
+    std::cout << "replay: " << replayTime << " s" << std::endl;
+
+    return EXIT_SUCCESS;
+  }
+}  // namespace bench
@@ -0,0 +1,548 @@
+#include "bench.hpp"
+#include "jit.hpp"
+#include "lexer.hpp"
+#include "input.hpp"
+#include "pipeline.hpp"
+#include "boundary.hpp"
+#include "generator.hpp"
+#include "classifier.hpp"
+#include "symbols.hpp"
+
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/**
+ * Regression suite: for every specification it measures
+ *   the generator: time of each phase (the best of the repeats) and the
+ *     growth of the peak resident memory while translating (in KiB),
+ *   the runtime: throughput (bytes and tokens per second, the best of the
+ *     repeats) of every backend for every alphabet over a synthetic corpus
+ *     (see generate()), the same corpus for all of them.
+ * The report is a JSON object, so the results of two commits may be compared.
+**/
+namespace bench {
+  struct Alphabet {
+    const char *name;
+    Ways::Options::Alphabet alphabet;
+  };
+
+  static const Alphabet ALPHABETS[] = {
+    {"8", Ways::Options::Alphabet8},
+    {"utf8", Ways::Options::AlphabetUtf8}
+  };
+  static const u32 ALPHABET_COUNT = sizeof(ALPHABETS) / sizeof(ALPHABETS[0]);
+
+  static const char *BACKENDS[] = {"lexer", "pipeline", "boundary", "pull", "jit", "classes", "symbols", "split", "stride2"};
+  static const u32 BACKEND_COUNT = sizeof(BACKENDS) / sizeof(BACKENDS[0]);
+
+  /**
+   * Drains the tokens the pipeline hands out, as a parser would
+  **/
+  static bool runPipeline(const Ways::Automaton &automaton, const std::string &corpus, u64 &tokens) {
+    input::Buffer source(corpus.data(), corpus.size());
+    pipeline::Pipeline<Ways::Automaton, input::Buffer> lexing(automaton, source);
+    lexer::Token batch[pipeline::Pipeline<Ways::Automaton, input::Buffer>::DEFAULT_BATCH_SIZE];
+
+    tokens = 0;
+    for (u32 count; (count = lexing.next(batch, sizeof(batch) / sizeof(batch[0]))) > 0; ) {
+      tokens += count;
+    }
+    return lexing.ok();
+  }
+
+  /**
+   * Marks the ends of the tokens in a bitmap (see boundary::Splitter)
+  **/
+  static bool runBoundary(const Ways::Automaton &automaton, const std::string &corpus, u64 &tokens) {
+    boundary::Splitter<Ways::Automaton> splitter(automaton);
+    input::Buffer source(corpus.data(), corpus.size());
+    const char *data;
+    u32 length;
+
+    while (source.next(data, length) && splitter.feed(data, length)) {
+    }
+    const bool success = splitter.ok() && splitter.finish();
+    tokens = splitter.ids().size() + splitter.mergedCount();
+    return success;
+  }
+
+  /**
+   * Pulls the tokens one at a time, feeding a block whenever it starves
+  **/
+  static bool runPull(const Ways::Automaton &automaton, const std::string &corpus, u64 &tokens) {
+    generator::Generator<Ways::Automaton> puller(automaton);
+    input::Buffer source(corpus.data(), corpus.size());
+    lexer::Token token;
+    const char *lexeme;
+    const char *data;
+    u32 length;
+
+    tokens = 0;
+    for (;;) {
+      switch (puller.next(token, lexeme)) {
+      case generator::Ready:
+        tokens++;
+        break;
+      case generator::Starved:
+        if (source.next(data, length)) {
+          puller.feed(data, length);
+        } else {
+          puller.close();
+        }
+        break;
+      case generator::Done:
+        return true;
+      default:
+        return false;
+      }
+    }
+  }
+
+  /**
+   * Counts the tokens, the interned ones by their symbol ids
+  **/
+  struct SymbolCounter : Counter {
+    void symbol(u32, u64, u32, u32) { tokens++; }
+  };
+
+  /**
+   * Interns the lexemes of the interned tokens as they are lexed
+  **/
+  static bool runSymbols(const Ways::Automaton &automaton, const std::string &corpus, u64 &tokens) {
+    SymbolCounter counter;
+    symbols::Table<char> table;
+    lexer::Lexer<Ways::Automaton, SymbolCounter> lexing(automaton, counter);
+    input::Buffer source(corpus.data(), corpus.size());
+    const char *data;
+    u32 length;
+
+    lexing.intern(&table);
+    while (source.next(data, length) && lexing.feed(data, length)) {
+    }
+    const bool success = lexing.ok() && lexing.finish();
+    tokens = counter.tokens;
+    return success;
+  }
+
+  template <class Automaton>
+  static bool runLexer(const Automaton &automaton, const std::string &corpus, u64 &tokens) {
+    Counter counter;
+    lexer::Lexer<Automaton, Counter> lexing(automaton, counter);
+    input::Buffer source(corpus.data(), corpus.size());
+    const char *data;
+    u32 length;
+
+    while (source.next(data, length) && lexing.feed(data, length)) {
+    }
+    const bool success = lexing.ok() && lexing.finish();
+    tokens = counter.tokens;
+    return success;
+  }
+
+  /**
+   * Transitions of @automaton in the split layout, as `--layout=split`
+   *   emits them (see Ways::split()): hot cells of the narrowest @Cell
+   * and the cold transitions aside
+  **/
+  template <class Cell>
+  class SplitLayout {
+  public:
+    typedef Ways::Transition Transition;
+    typedef Ways::Automaton::Char Char;
+
+  public:
+    SplitLayout(const Ways::Automaton &automaton, const std::vector<u32> &cells, const std::vector<Transition> &cold) :
+    mAutomaton(automaton),
+    mCells(cells.begin(), cells.end()),
+    mCold(cold) {
+    }
+
+    u32 initialState() const { return mAutomaton.initialState(); }
+    u32 eosClass() const { return mAutomaton.eosClass(); }
+    u32 classOf(u32 c) const { return mAutomaton.classOf(c); }
+    Transition transition(u32 stateId, u32 classId) const {
+      const u32 cell = mCells[stateId * mAutomaton.classCount + classId];
+      if (cell & 3) {
+        Transition hot;
+        hot.state = cell >> 2;
+        hot.action = Transition::ActionContinue;
+        hot.mode = u8(cell & 3);
+        return hot;
+      }
+      return mCold[cell >> 2];
+    }
+    u32 keyword(u32 token, const Char *lexeme, u32 length) const { return mAutomaton.keyword(token, lexeme, length); }
+
+  private:
+    const Ways::Automaton &mAutomaton;
+    std::vector<Cell> mCells;
+    std::vector<Transition> mCold;
+  };
+
+  /**
+   * @automaton with the table of pairs `--stride=2` emits (see Ways::pairs()),
+   *   of the narrowest @Cell
+  **/
+  template <class Cell>
+  class PairsLayout {
+  public:
+    typedef Ways::Transition Transition;
+    typedef Ways::Automaton::Char Char;
+
+  public:
+    PairsLayout(const Ways::Automaton &automaton, const std::vector<u32> &pairs) :
+    mAutomaton(automaton),
+    mPairs(pairs.begin(), pairs.end()),
+    mWidth(automaton.classCount - 1) {
+    }
+
+    u32 initialState() const { return mAutomaton.initialState(); }
+    u32 eosClass() const { return mAutomaton.eosClass(); }
+    u32 classOf(u32 c) const { return mAutomaton.classOf(c); }
+    const Transition &transition(u32 stateId, u32 classId) const { return mAutomaton.transition(stateId, classId); }
+    u32 keyword(u32 token, const Char *lexeme, u32 length) const { return mAutomaton.keyword(token, lexeme, length); }
+
+    // Stride-2 interface
+    typedef u32 Pair;
+    u32 pair(u32 stateId, u32 firstClass, u32 secondClass) const { return mPairs[(stateId * mWidth + firstClass) * mWidth + secondClass]; }
+
+  private:
+    const Ways::Automaton &mAutomaton;
+    std::vector<Cell> mPairs;
+    u32 mWidth;
+  };
+
+  /**
+   * Lexer over a layout of tables, built once out of the measured time
+  **/
+  struct Layout {
+    virtual ~Layout() {}
+    virtual bool run(const std::string &corpus, u64 &tokens) const = 0;
+  };
+
+  template <class Automaton>
+  struct LayoutOf : Layout {
+    explicit LayoutOf(const Automaton &automaton) : automaton(automaton) {}
+    bool run(const std::string &corpus, u64 &tokens) const { return runLexer(automaton, corpus, tokens); }
+
+    Automaton automaton;
+  };
+
+  /**
+   * Returns the split layout of @automaton
+  **/
+  static Layout *splitLayout(const Ways::Automaton &automaton) {
+    std::vector<u32> cells;
+    std::vector<Ways::Transition> cold;
+    Ways::split(automaton, cells, cold);
+
+    const u32 maximum = *std::max_element(cells.begin(), cells.end());
+    if (maximum <= 0xff) {
+      return new LayoutOf< SplitLayout<u8> >(SplitLayout<u8>(automaton, cells, cold));
+    }
+    if (maximum <= 0xffff) {
+      return new LayoutOf< SplitLayout<u16> >(SplitLayout<u16>(automaton, cells, cold));
+    }
+    return new LayoutOf< SplitLayout<u32> >(SplitLayout<u32>(automaton, cells, cold));
+  }
+
+  /**
+   * Returns the stride-2 layout of @automaton, null if its table of pairs
+   *   is over the default limit (the generator emits stride 1 then)
+  **/
+  static Layout *pairsLayout(const Ways::Automaton &automaton) {
+    if (Ways::pairsSize(automaton) > Ways::Options::DEFAULT_STRIDE_LIMIT) {
+      return 0;
+    }
+    std::vector<u32> pairs;
+    Ways::pairs(automaton, pairs);
+
+    const u32 maximum = (automaton.stateCount - 1) << 4 | 0xf;
+    if (maximum <= 0xff) {
+      return new LayoutOf< PairsLayout<u8> >(PairsLayout<u8>(automaton, pairs));
+    }
+    if (maximum <= 0xffff) {
+      return new LayoutOf< PairsLayout<u16> >(PairsLayout<u16>(automaton, pairs));
+    }
+    return new LayoutOf< PairsLayout<u32> >(PairsLayout<u32>(automaton, pairs));
+  }
+
+  /**
+   * Translates @spec in a child process, so the peak resident memory
+   *   of the generator is not hidden by the one of the suite.
+   * Returns true if succeeds or false if fails.
+  **/
+  static bool runGenerator(const std::string &spec, const Ways::Options &options, u64 &peak) {
+    int channel[2];
+    if (pipe(channel) != 0) {
+      return false;
+    }
+
+    const pid_t child = fork();
+    if (child == 0) {
+      close(channel[0]);
+      // The peak of a new process starts at the memory it shares with the parent
+      rusage before, after;
+      getrusage(RUSAGE_SELF, &before);
+      std::istringstream in(spec);
+      std::ostringstream out;
+      const bool success = Ways::translate(in, out, 0, options);
+      getrusage(RUSAGE_SELF, &after);
+      const u64 growth = success ? u64(after.ru_maxrss - before.ru_maxrss) : u64(-1);
+      _exit(write(channel[1], &growth, sizeof(growth)) == ssize_t(sizeof(growth)) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(channel[1]);
+    const bool success = child > 0 && read(channel[0], &peak, sizeof(peak)) == ssize_t(sizeof(peak)) && peak != u64(-1);
+    close(channel[0]);
+    int status;
+    if (child > 0) {
+      waitpid(child, &status, 0);
+    }
+    return success;
+  }
+
+  /**
+   * Prints out @text as a JSON string
+  **/
+  static void quote(std::ostream &out, const std::string &text) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    out << '"';
+    for (u32 i = 0; i < text.size(); ++i) {
+      const u8 c = text[i];
+      if (c == '"' || c == '\\') {
+        out << '\\' << char(c);
+      } else if (c < 0x20) {
+        out << "\\u00" << HEX_DIGITS[c >> 4] << HEX_DIGITS[c & 0xf];
+      } else {
+        out << char(c);
+      }
+    }
+    out << '"';
+  }
+
+  /**
+   * Measures the specification @path and prints out (to @out) its report.
+   * Returns true if succeeds or false if fails.
+  **/
+  static bool measure(const std::string &path, u64 size, u64 seed, u32 repeat, std::ostream &out) {
+    out << "    {" << std::endl << "      \"spec\": ";
+    quote(out, path);
+    out << ',' << std::endl;
+
+    std::ifstream file(path.c_str());
+    const std::string spec((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // Generator
+    std::ostringstream log;
+    Ways::Automaton automata[ALPHABET_COUNT];
+    Jit jits[ALPHABET_COUNT];
+    bool compiled[ALPHABET_COUNT];
+    Ways::Statistics statistics[ALPHABET_COUNT];
+    u64 peaks[ALPHABET_COUNT];
+    bool success = file.good();
+    Ways::diagnostics(&log);
+    for (u32 a = 0; a < ALPHABET_COUNT && success; ++a) {
+      Ways::Options options;
+      options.alphabet = ALPHABETS[a].alphabet;
+
+      for (u32 r = 0; r < repeat && success; ++r) {
+        Ways::Statistics current;
+        std::istringstream in(spec);
+        std::ostringstream tables;
+        success = Ways::translate(in, tables, &current, options);
+        const double total = current.parseTime + current.partitionTime + current.rowsTime + current.emitTime;
+        const Ways::Statistics &best = statistics[a];
+        if (r == 0 || total < best.parseTime + best.partitionTime + best.rowsTime + best.emitTime) {
+          statistics[a] = current;
+        }
+      }
+
+      std::istringstream in(spec);
+      success = success && Ways::build(in, automata[a], 0, options) && runGenerator(spec, options, peaks[a]);
+      // Automata the JIT does not compile are measured by the other backends only
+      compiled[a] = success && jits[a].compile(automata[a]);
+    }
+    Ways::diagnostics(0);
+
+    if (!success) {
+      out << "      \"error\": ";
+      quote(out, file ? log.str() : "unable to read the specification");
+      out << std::endl << "    }";
+      return false;
+    }
+
+    out << "      \"generator\": [";
+    for (u32 a = 0; a < ALPHABET_COUNT; ++a) {
+      const Ways::Statistics &best = statistics[a];
+      u64 tables = 0;
+      for (u32 i = 0; i < best.tables.size(); ++i) {
+        tables += best.tables[i].bytes;
+      }
+      out << (a == 0 ? "" : ",") << std::endl
+          << "        {\"alphabet\": \"" << ALPHABETS[a].name << "\", "
+          << "\"time\": {\"parse\": " << best.parseTime << ", \"partition\": " << best.partitionTime
+          << ", \"rows\": " << best.rowsTime << ", \"emit\": " << best.emitTime
+          << ", \"total\": " << (best.parseTime + best.partitionTime + best.rowsTime + best.emitTime) << "}, "
+          << "\"states\": " << best.stateCount << ", \"classes\": " << best.classCount << ", "
+          << "\"memory\": {\"peak\": " << peaks[a] << ", \"tables\": " << tables << "}}";
+    }
+    out << std::endl << "      ]," << std::endl;
+
+    // Runtime
+    std::string corpus;
+    if (!generate(automata[0], size, seed, corpus)) {
+      out << "      \"error\": \"the walk over the automaton got stuck\"" << std::endl << "    }";
+      return false;
+    }
+
+    // Automata of classes wider than bytes are measured by the other backends only
+    classifier::Classifier<Ways::Automaton> *classifiers[ALPHABET_COUNT];
+    for (u32 a = 0; a < ALPHABET_COUNT; ++a) {
+      classifiers[a] = new classifier::Classifier<Ways::Automaton>(automata[a]);
+    }
+    // So are the ones with no interned token by the symbols backend,
+    //   and the ones of too large tables of pairs by the stride-2 one
+    const bool interning = std::find(automata[0].internedTokens.begin(), automata[0].internedTokens.end(), 1) != automata[0].internedTokens.end();
+    Layout *splits[ALPHABET_COUNT];
+    Layout *strides[ALPHABET_COUNT];
+    for (u32 a = 0; a < ALPHABET_COUNT; ++a) {
+      splits[a] = splitLayout(automata[a]);
+      strides[a] = pairsLayout(automata[a]);
+    }
+
+    u64 expected = 0;
+    out << "      \"runtime\": [";
+    for (u32 a = 0; a < ALPHABET_COUNT && success; ++a) {
+      for (u32 b = 0; b < BACKEND_COUNT && success; ++b) {
+        if ((b == 4 && !compiled[a]) || (b == 5 && !classifiers[a]->fits()) || (b == 6 && !interning) || (b == 8 && !strides[a])) {
+          continue;
+        }
+        double best = 0;
+        u64 tokens = 0;
+        for (u32 r = 0; r < repeat && success; ++r) {
+          const double start = now();
+          switch (b) {
+          case 0:
+            success = runLexer(automata[a], corpus, tokens);
+            break;
+          case 1:
+            success = runPipeline(automata[a], corpus, tokens);
+            break;
+          case 2:
+            success = runBoundary(automata[a], corpus, tokens);
+            break;
+          case 3:
+            success = runPull(automata[a], corpus, tokens);
+            break;
+          case 4:
+            success = runLexer(jits[a], corpus, tokens);
+            break;
+          case 5:
+            success = runLexer(*classifiers[a], corpus, tokens);
+            break;
+          case 6:
+            success = runSymbols(automata[a], corpus, tokens);
+            break;
+          case 7:
+            success = splits[a]->run(corpus, tokens);
+            break;
+          default:
+            success = strides[a]->run(corpus, tokens);
+          }
+          const double time = now() - start;
+          if (r == 0 || time < best) {
+            best = time;
+          }
+        }
+        if (a == 0 && b == 0) {
+          expected = tokens;
+        }
+        success = success && tokens == expected;
+
+        out << (a == 0 && b == 0 ? "" : ",") << std::endl
+            << "        {\"alphabet\": \"" << ALPHABETS[a].name << "\", \"backend\": \"" << BACKENDS[b] << "\", "
+            << "\"time\": " << best << ", \"throughput\": {\"bytes\": " << corpus.size() / best
+            << ", \"tokens\": " << tokens / best << "}";
+        if (!success) {
+          out << ", \"error\": \"the corpus lexes differently\"";
+        }
+        out << '}';
+      }
+    }
+    out << std::endl << "      ]," << std::endl
+        << "      \"corpus\": {\"bytes\": " << corpus.size() << ", \"tokens\": " << expected << "}" << std::endl
+        << "    }";
+
+    for (u32 a = 0; a < ALPHABET_COUNT; ++a) {
+      delete classifiers[a];
+      delete splits[a];
+      delete strides[a];
+    }
+    return success;
+  }
+
+  int suite(int argc, char **argv) {
+    u64 size = DEFAULT_CORPUS_SIZE;
+    u64 seed = DEFAULT_SEED;
+    u32 repeat = 3;
+    const char *output = 0;
+    std::vector<std::string> specs;
+
+    for (int i = 0; i < argc; ++i) {
+      if (std::strncmp(argv[i], "--size=", 7) == 0) {
+        size = std::strtoull(argv[i] + 7, 0, 10);
+      } else if (std::strncmp(argv[i], "--seed=", 7) == 0) {
+        seed = std::strtoull(argv[i] + 7, 0, 10);
+      } else if (std::strncmp(argv[i], "--repeat=", 9) == 0) {
+        repeat = std::strtoul(argv[i] + 9, 0, 10);
+      } else if (std::strncmp(argv[i], "--output=", 9) == 0) {
+        output = argv[i] + 9;
+      } else {
+        specs.push_back(argv[i]);
+      }
+    }
+    if (specs.empty() || repeat == 0) {
+      std::cerr << "usage: suite [--size=<bytes>] [--seed=<n>] [--repeat=<n>] [--output=<report>] <spec>..." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::ofstream file;
+    if (output) {
+      file.open(output);
+      if (!file) {
+        std::cerr << "error: unable to open `" << output << "` for writing" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    std::ostream &out = output ? file : std::cout;
+
+    out << "{" << std::endl
+        << "  \"version\": \"" << Ways::VERSION << "\"," << std::endl
+        << "  \"size\": " << size << ',' << std::endl
+        << "  \"seed\": " << seed << ',' << std::endl
+        << "  \"repeat\": " << repeat << ',' << std::endl
+        << "  \"specs\": [";
+    u32 failures = 0;
+    for (u32 i = 0; i < specs.size(); ++i) {
+      out << (i == 0 ? "" : ",") << std::endl;
+      if (!measure(specs[i], size, seed, repeat, out)) {
+        std::cerr << "warning: `" << specs[i] << "` is not measured completely" << std::endl;
+        failures++;
+      }
+    }
+    out << std::endl << "  ]" << std::endl << "}" << std::endl;
+
+    return out.good() && failures < specs.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+}  // namespace bench
@@ -0,0 +1,178 @@
+#include <elib/aliases.hpp>
+
+#include <cstring>
+
+namespace bootstrap {
+  using namespace elib::aliases;
+
+  const u32 charsetSize = 256;
+  const u32 classCount = 16;
+  const u32 stateCount = 8;
+  const u32 initialStateId = 0;
+
+  const u8 classMap[charsetSize] = {
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       1,   0,   7,   0,   0,   0,   0,   0,   4,   5,   0,   0,   0,   0,   8,   0,
+       9,   9,   9,   9,   9,   9,   9,   9,   9,   9,   2,   3,   0,   0,   0,   0,
+       0,  13,  13,  13,  13,  13,  13,   6,   6,   6,   6,   6,   6,   6,   6,   6,
+       6,   6,   6,   6,   6,   6,   6,   6,   6,   6,   6,   0,  10,   0,   0,   6,
+       0,  13,  13,  13,  13,  13,  13,   6,   6,   6,   6,   6,   6,   6,   6,   6,
+       6,   6,   6,   6,   6,  11,   6,   6,   6,   6,   6,  12,   0,  14,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+       0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0
+  };
+
+  const char *failureMessages[] = {
+    "incomplete range operator `..`",
+    "unterminated string",
+    "missing expected left brace of code point escape",
+    "invalid code point escape"
+  };
+
+  struct Tokens {
+    enum {
+      colon,
+      semicolon,
+      left_paren,
+      right_paren,
+      dots,
+      identifier,
+      string,
+      kw_keywords,
+      kw_keyword,
+      kw_state,
+      kw_initial,
+      kw_transition,
+      kw_on,
+      kw_end,
+      kw_go,
+      kw_keep,
+      kw_skip,
+      kw_clear,
+      kw_token,
+      kw_failure,
+      kw_sync,
+      kw_intern
+    };
+  };
+
+  const u32 keywordSeed = 288;
+  const u32 keywordTableSize = 32;
+
+  struct Keyword {
+    const char *lexeme;
+    u32 length;
+    u32 base;
+    u32 token;
+  };
+
+  const Keyword keywords[keywordTableSize] = {
+    {"clear", 5, 5, 17},
+    {"keep", 4, 5, 15},
+    {"intern", 6, 5, 21},
+    {"keyword", 7, 5, 8},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"skip", 4, 5, 16},
+    {"end", 3, 5, 13},
+    {0, 0, 0, 0},
+    {"failure", 7, 5, 19},
+    {"keywords", 8, 5, 7},
+    {"go", 2, 5, 14},
+    {0, 0, 0, 0},
+    {"transition", 10, 5, 11},
+    {"token", 5, 5, 18},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"sync", 4, 5, 20},
+    {"initial", 7, 5, 10},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"on", 2, 5, 12},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"state", 5, 5, 9}
+  };
+
+  inline u32 keywordHash(u32 base, const char *lexeme, u32 length) {
+    u32 hash = (keywordSeed ^ (base * 0x9e3779b1UL)) & 0xffffffffUL;
+    for (u32 i = 0; i < length; ++i) {
+      hash = ((hash ^ u8(lexeme[i])) * 16777619UL) & 0xffffffffUL;
+    }
+    return (hash ^ (hash >> 15)) & (keywordTableSize - 1);
+  }
+
+  // Returns the keyword token matching the lexeme of @token or @token itself
+  inline u32 keyword(u32 token, const char *lexeme, u32 length) {
+    const Keyword &entry = keywords[keywordHash(token, lexeme, length)];
+    if (entry.lexeme != 0 && entry.base == token && entry.length == length && std::memcmp(entry.lexeme, lexeme, length) == 0) {
+      return entry.token;
+    }
+    return token;
+  }
+
+  struct Transition {
+  public:
+    enum {
+      ActionInvalid,
+      ActionContinue,
+      ActionClear,
+      ActionToken,
+      ActionFailure,
+      ActionRecover
+    };
+
+    enum {
+      ModeLeave,
+      ModeKeep,
+      ModeSkip,
+      ModePend,
+      ModeKeepPending,
+      ModeSkipPending,
+      ModeLeavePending
+    };
+  
+  public:
+    u32 state;
+    u8 action;
+    u8 mode;
+    u32 arg;
+  };
+
+  const Transition transitions[stateCount][classCount] = {
+    {{0, 0, 0, 0}, {0, 1, 2, 0}, {0, 3, 1, 0}, {0, 3, 1, 1}, {0, 3, 1, 2}, {0, 3, 1, 3}, {2, 1, 1, 0}, {3, 1, 2, 0}, {1, 1, 1, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {2, 1, 1, 0}, {0, 0, 0, 0}, {2, 1, 1, 0}, {0, 0, 0, 0}, {0, 1, 2, 0}},
+    {{1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {0, 3, 1, 4}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}, {1, 4, 0, 0}},
+    {{0, 3, 0, 5}, {0, 3, 0, 5}, {0, 3, 0, 5}, {0, 3, 0, 5}, {0, 3, 0, 5}, {0, 3, 0, 5}, {2, 1, 1, 0}, {0, 3, 0, 5}, {0, 3, 0, 5}, {2, 1, 1, 0}, {0, 3, 0, 5}, {2, 1, 1, 0}, {0, 3, 0, 5}, {2, 1, 1, 0}, {0, 3, 0, 5}, {0, 3, 0, 5}},
+    {{3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {0, 3, 2, 6}, {3, 1, 1, 0}, {3, 1, 1, 0}, {4, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 4, 0, 1}},
+    {{3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {5, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {3, 1, 1, 0}, {4, 4, 0, 1}},
+    {{5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}, {6, 1, 1, 0}, {5, 4, 0, 2}, {5, 4, 0, 2}, {5, 4, 0, 2}},
+    {{6, 4, 0, 3}, {6, 4, 0, 3}, {6, 4, 0, 3}, {6, 4, 0, 3}, {6, 4, 0, 3}, {6, 4, 0, 3}, {6, 4, 0, 3}, {6, 4, 0, 3}, {6, 4, 0, 3}, {7, 1, 1, 0}, {6, 4, 0, 3}, {6, 4, 0, 3}, {6, 4, 0, 3}, {7, 1, 1, 0}, {6, 4, 0, 3}, {6, 4, 0, 3}},
+    {{7, 4, 0, 3}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 1, 1, 0}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 4, 0, 3}, {7, 1, 1, 0}, {3, 1, 1, 0}, {7, 4, 0, 3}}
+  };
+
+  // Automaton interface of the runtime lexer (see runtime/lexer.hpp)
+  struct Automaton {
+    typedef bootstrap::Transition Transition;
+    typedef char Char;
+
+    u32 initialState() const { return initialStateId; }
+    u32 eosClass() const { return classCount - 1; }
+    u32 classOf(u8 c) const { return classMap[c]; }
+    const Transition &transition(u32 stateId, u32 classId) const { return transitions[stateId][classId]; }
+    u32 keyword(u32 token, const char *lexeme, u32 length) const { return bootstrap::keyword(token, lexeme, length); }
+  };
+}  // namespace
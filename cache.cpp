@@ -0,0 +1,177 @@
+#include "cache.hpp"
+
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+
+static const char *ENTRY_MAGIC = "WAYSCACHE1";
+static const char *ENTRY_SUFFIX = ".entry";
+static const char *TEMPORARY_PREFIX = ".tmp.";
+static const time_t TEMPORARY_LIFETIME = 24 * 60 * 60;  // Leftovers of killed writers
+
+
+static void hash(u64 &h1, u64 &h2, const std::string &data) {
+    for (u32 i = 0; i < data.length(); ++i) {
+        h1 = (h1 ^ u8(data[i])) * 0x100000001b3ULL;
+        h2 = (h2 + u8(data[i]) + 1) * 0x9e3779b97f4a7c15ULL;
+        h2 ^= h2 >> 29;
+    }
+    // Separates the fields, so "ab" + "c" and "a" + "bc" differ
+    h1 = (h1 ^ 0xff) * 0x100000001b3ULL;
+    h2 = (h2 + data.length()) * 0xbf58476d1ce4e5b9ULL;
+    h2 ^= h2 >> 31;
+}
+
+
+static bool endsWith(const std::string &value, const char *suffix) {
+    const std::string tail(suffix);
+    return value.length() >= tail.length() && value.compare(value.length() - tail.length(), tail.length(), tail) == 0;
+}
+
+
+Cache::Cache(const std::string &directory, u64 capacity) :
+  mDirectory(directory),
+  mCapacity(capacity) {
+    if (mkdir(mDirectory.c_str(), 0777) != 0 && errno != EEXIST) {
+        Ways::diagnostics() << "warning: unable to create cache directory `" << mDirectory << '`' << std::endl;
+    }
+}
+
+
+std::string Cache::key(const std::string &spec, const Ways::Options &options) {
+    u64 h1 = 0xcbf29ce484222325ULL;
+    u64 h2 = 0x6a09e667f3bcc908ULL;
+    hash(h1, h2, Ways::VERSION);
+    hash(h1, h2, options.key());
+    hash(h1, h2, spec);
+
+    char text[33];
+    std::sprintf(text, "%016llx%016llx", (unsigned long long)h1, (unsigned long long)h2);
+    return text;
+}
+
+
+bool Cache::lookup(const std::string &key, const std::string &spec, std::string &tables) const {
+    const std::string entryPath = path(key);
+    std::ifstream in(entryPath.c_str(), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    std::string magic;
+    u64 specLength = 0;
+    if (!(in >> magic >> specLength) || magic != ENTRY_MAGIC || specLength != spec.length() || in.get() != '\n') {
+        return false;
+    }
+
+    std::string storedSpec(specLength, '\0');
+    if (specLength > 0 && !in.read(&storedSpec[0], specLength)) {
+        return false;
+    }
+    if (storedSpec != spec) {
+        return false;
+    }
+
+    std::ostringstream text;
+    text << in.rdbuf();
+    tables = text.str();
+
+    // Recently used entries are the last to be trimmed
+    utime(entryPath.c_str(), 0);
+    return true;
+}
+
+
+void Cache::store(const std::string &key, const std::string &spec, const std::string &tables) const {
+    static u32 counter = 0;
+    std::ostringstream temporary;
+    temporary << mDirectory << '/' << TEMPORARY_PREFIX << getpid() << '.' << __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+    const std::string temporaryPath = temporary.str();
+
+    std::ofstream out(temporaryPath.c_str(), std::ios::binary);
+    out << ENTRY_MAGIC << ' ' << spec.length() << '\n';
+    out.write(spec.data(), spec.length());
+    out.write(tables.data(), tables.length());
+    out.close();
+
+    if (!out || std::rename(temporaryPath.c_str(), path(key).c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        Ways::diagnostics() << "warning: unable to store tables into cache `" << mDirectory << '`' << std::endl;
+        return;
+    }
+
+    trim();
+}
+
+
+bool Cache::translate(std::istream &in, std::ostream &out, const Ways::Options &options) const {
+    std::ostringstream text;
+    text << in.rdbuf();
+    const std::string spec = text.str();
+    const std::string specKey = key(spec, options);
+
+    std::string tables;
+    if (!lookup(specKey, spec, tables)) {
+        std::istringstream specIn(spec);
+        std::ostringstream tablesOut;
+        if (!Ways::translate(specIn, tablesOut, 0, options)) {
+            return false;
+        }
+        tables = tablesOut.str();
+        store(specKey, spec, tables);
+    }
+
+    out.write(tables.data(), tables.length());
+    return true;
+}
+
+
+std::string Cache::path(const std::string &key) const {
+    return mDirectory + '/' + key + ENTRY_SUFFIX;
+}
+
+
+void Cache::trim() const {
+    DIR *directory = opendir(mDirectory.c_str());
+    if (!directory) {
+        return;
+    }
+
+    std::vector<std::pair<time_t, std::pair<u64, std::string> > > entries;
+    u64 size = 0;
+    const time_t now = std::time(0);
+
+    for (struct dirent *entry = readdir(directory); entry; entry = readdir(directory)) {
+        const std::string name(entry->d_name);
+        const std::string entryPath = mDirectory + '/' + name;
+        struct stat info;
+        if (stat(entryPath.c_str(), &info) != 0) {
+            continue;
+        }
+
+        if (endsWith(name, ENTRY_SUFFIX)) {
+            entries.push_back(std::make_pair(info.st_mtime, std::make_pair(u64(info.st_size), entryPath)));
+            size += info.st_size;
+        } else if (name.compare(0, std::string(TEMPORARY_PREFIX).length(), TEMPORARY_PREFIX) == 0
+                   && now - info.st_mtime > TEMPORARY_LIFETIME) {
+            std::remove(entryPath.c_str());
+        }
+    }
+    closedir(directory);
+
+    // Least recently used first; concurrent trims may remove the same entries
+    std::sort(entries.begin(), entries.end());
+    for (u32 i = 0; i < entries.size() && size > mCapacity; ++i) {
+        std::remove(entries[i].second.second.c_str());
+        size -= entries[i].second.first;
+    }
+}
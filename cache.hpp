@@ -0,0 +1,66 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "ways.hpp"
+
+#include <iostream>
+#include <string>
+#include <elib/aliases.hpp>
+using namespace elib::aliases;
+
+/**
+ * Content-addressed cache of generated tables.
+ *
+ * An entry is keyed on a hash of the specification, the generator version
+ *   and the output options; it stores the specification itself as well,
+ * so a hash collision is detected on lookup and costs a miss only.
+ *
+ * Entries are written to a temporary file and renamed into place, so
+ *   concurrent generators never see a partial entry (the last writer wins,
+ * all of them write the same tables). Once the entries exceed the size cap
+ * the least recently used ones are removed.
+**/
+class Cache {
+public:
+    static const u64 DEFAULT_CAPACITY = u64(256) << 20;  // In bytes
+
+public:
+    /**
+     * @directory is created unless it exists
+    **/
+    explicit Cache(const std::string &directory, u64 capacity = DEFAULT_CAPACITY);
+
+    /**
+     * Translates @in to @out like Ways::translate, but takes the tables from
+     *   the cache if they were generated from the same spec with @options.
+     * Returns true if succeeds or false if fails.
+    **/
+    bool translate(std::istream &in, std::ostream &out, const Ways::Options &options) const;
+
+    /**
+     * Key of the tables generated from @spec with @options
+    **/
+    static std::string key(const std::string &spec, const Ways::Options &options);
+
+    /**
+     * Reads the tables stored with @key for @spec into @tables.
+     * Returns true if there is such an entry or false otherwise.
+    **/
+    bool lookup(const std::string &key, const std::string &spec, std::string &tables) const;
+
+    /**
+     * Stores @tables generated from @spec with @key and trims the cache.
+     *   Failures are not fatal: the tables are just regenerated next time.
+    **/
+    void store(const std::string &key, const std::string &spec, const std::string &tables) const;
+
+private:
+    std::string path(const std::string &key) const;
+    void trim() const;
+
+private:
+    std::string mDirectory;
+    u64 mCapacity;
+};
+
+#endif // CACHE_HPP
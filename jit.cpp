@@ -0,0 +1,372 @@
+#include "jit.hpp"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__)
+  #include <unistd.h>
+  #include <sys/mman.h>
+#endif
+
+
+#if defined(__x86_64__)
+/**
+ * Writer of x86-64 code (and of its data) into a buffer.
+ *   Jumps to the code of a label not written yet are fixed up once all
+ * of it is written, see resolve().
+**/
+class Emitter {
+public:
+    explicit Emitter(u8 *at) : mAt(at) {}
+
+    void bytes(const char *code, u32 length) {
+        std::memcpy(mAt, code, length);
+        mAt += length;
+    }
+
+    void imm32(u32 value) { little(value, 4); }
+    void imm64(u64 value) { little(value, 8); }
+
+    /**
+     * Displacement to @label (relative to the end of the instruction,
+     *   which the displacement ends)
+    **/
+    void rel32(u64 label) {
+        Fixup fixup = {mAt, label};
+        mFixups.push_back(fixup);
+        mAt += 4;
+    }
+
+    /**
+     * Places @label at the current address
+    **/
+    void place(u64 label) {
+        if (label >= mLabels.size()) {
+            mLabels.resize(label + 1, 0);
+        }
+        mLabels[label] = mAt;
+    }
+
+    const u8 *address(u64 label) const { return mLabels[label]; }
+
+    void resolve() {
+        for (u64 i = 0; i < mFixups.size(); ++i) {
+            const Fixup &fixup = mFixups[i];
+            const u32 displacement = u32(mLabels[fixup.label] - (fixup.at + 4));
+            for (u32 b = 0; b < 4; ++b) {
+                fixup.at[b] = u8(displacement >> 8*b);
+            }
+        }
+        mFixups.clear();
+    }
+
+private:
+    struct Fixup {
+        u8 *at;
+        u64 label;
+    };
+
+    void little(u64 value, u32 length) {
+        for (u32 i = 0; i < length; ++i) {
+            *mAt++ = u8(value >> 8*i);
+        }
+    }
+
+private:
+    u8 *mAt;
+    std::vector<u8 *> mLabels;
+    std::vector<Fixup> mFixups;
+};
+
+// Sizes of the pieces of code
+static const u32 ENTRY_SIZE = 53;
+static const u32 BLOCK_SIZE = 21;         // With the jump to the exit
+static const u32 BRANCH_SIZE = 24;        // Per state a block continues to
+static const u32 ACTIONS_SIZE = 25;       // Over the block, with the test of the actions
+static const u32 TABLE_SIZE = 8;          // Over the block, with the jump through a table
+static const u32 CONTINUATION_SIZE = 8;
+static const u32 STUB_SIZE = 10;
+static const u32 ACTION_SIZE = 36;
+static const u32 EXIT_SIZE = 15;
+static const u32 EPILOGUE_SIZE = 15;
+
+static bool wider(const std::pair<u64, u64> &left, const std::pair<u64, u64> &right) {
+    return __builtin_popcountll(left.first) > __builtin_popcountll(right.first);
+}
+
+// Whether the code calls the lexer back for @transition: the actions on
+//   a whole character, multibyte ones return to the lexer
+static bool acts(const Jit::Transition &transition) {
+    return transition.action != Jit::Transition::ActionContinue
+        && (transition.mode == Jit::Transition::ModeLeave || transition.mode == Jit::Transition::ModeKeep || transition.mode == Jit::Transition::ModeSkip);
+}
+#endif
+
+
+Jit::Jit() :
+mAutomaton(0),
+mCode(0),
+mSize(0) {
+    mRuns[0] = mRuns[1] = 0;
+}
+
+Jit::~Jit() {
+    release();
+}
+
+void Jit::release() {
+#if defined(__x86_64__)
+    if (mCode) {
+        munmap(mCode, mSize);
+    }
+#endif
+    mCode = 0;
+    mSize = 0;
+    mRuns[0] = mRuns[1] = 0;
+}
+
+bool Jit::compile(const Ways::Automaton &automaton, u64 limit) {
+    release();
+
+#if defined(__x86_64__)
+    if (automaton.alphabetSize > 256) {
+        Ways::diagnostics() << "warning: only byte alphabets are compiled to native code" << std::endl;
+        return false;
+    }
+
+    // Rows have no cell for the end of input, the code never reads it.
+    //   A row of up to 64 classes is coded as a bit test of the class per
+    // state it continues to, a wider one as a jump through a table
+    const u64 stateCount = automaton.stateCount;
+    const u64 width = automaton.classCount - 1;
+    const bool tables = width > 64;
+
+    // Per mode and state: the states it continues to and the classes to them,
+    //   then per state the classes it acts on
+    std::vector<std::vector<std::pair<u64, u64> > > branches(2*stateCount);
+    std::vector<u64> actions(stateCount, 0);
+    u64 codeSize = 2*ENTRY_SIZE + ACTION_SIZE + stateCount*EXIT_SIZE + EPILOGUE_SIZE;
+    for (u64 stateId = 0; stateId < stateCount && !tables; ++stateId) {
+        for (u64 classId = 0; classId < width; ++classId) {
+            if (acts(automaton.transition(stateId, classId))) {
+                actions[stateId] |= u64(1) << classId;
+            }
+        }
+    }
+    for (u32 m = 0; m < 2 && !tables; ++m) {
+        const u32 mode = m == 0 ? Transition::ModeKeep : Transition::ModeSkip;
+        for (u64 stateId = 0; stateId < stateCount; ++stateId) {
+            std::vector<std::pair<u64, u64> > &targets = branches[m*stateCount + stateId];
+            for (u64 classId = 0; classId < width; ++classId) {
+                const Transition &transition = automaton.transition(stateId, classId);
+                if (transition.action != Transition::ActionContinue || transition.mode != mode) {
+                    continue;
+                }
+                u32 i = 0;
+                while (i < targets.size() && targets[i].second != transition.state) {
+                    ++i;
+                }
+                if (i == targets.size()) {
+                    targets.push_back(std::make_pair(u64(0), u64(transition.state)));
+                }
+                targets[i].first |= u64(1) << classId;
+            }
+            // The widest branch is tested first
+            std::sort(targets.begin(), targets.end(), wider);
+            codeSize += BLOCK_SIZE + targets.size()*BRANCH_SIZE + (actions[stateId] ? ACTIONS_SIZE : 0);
+        }
+    }
+    if (tables) {
+        codeSize += 2*stateCount*(BLOCK_SIZE + TABLE_SIZE + CONTINUATION_SIZE + STUB_SIZE);
+    }
+
+    // Data: classes of the bytes, entry blocks (per mode and state) and the rows
+    //   of the tables, then the code: entries (per mode), blocks (per mode and
+    // state, continuations and stubs of the actions after them if there are
+    // tables), the call of the actions, exits (per state) and the return
+    const u64 classesOffset = 0;
+    const u64 entriesOffset = classesOffset + 256*4;
+    const u64 rowsOffset = entriesOffset + 2*stateCount*8;
+    const u64 codeOffset = (rowsOffset + (tables ? 2*stateCount*width*8 : 0) + 15) & ~u64(15);
+    const u64 pageSize = sysconf(_SC_PAGESIZE);
+    const u64 size = (codeOffset + codeSize + pageSize - 1) / pageSize * pageSize;
+
+    if (size > limit || stateCount > 0x7fffffff) {
+        Ways::diagnostics() << "warning: native code takes " << size << " bytes, over the limit of " << limit << std::endl;
+        return false;
+    }
+
+    void *code = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        Ways::diagnostics() << "warning: unable to map " << size << " bytes for native code" << std::endl;
+        return false;
+    }
+    u8 *const base = static_cast<u8 *>(code);
+
+    // 32-bit whatever u32 is: the code scales the byte by 4
+    unsigned int *const classes = reinterpret_cast<unsigned int *>(base + classesOffset);
+    u64 *const entries = reinterpret_cast<u64 *>(base + entriesOffset);
+    u64 *const rows = reinterpret_cast<u64 *>(base + rowsOffset);
+    for (u32 c = 0; c < 256; ++c) {
+        classes[c] = c < automaton.alphabetSize ? automaton.classOf(c) : 0;
+    }
+
+    // Labels: blocks, continuations, stubs of the actions (all per mode and
+    //   state), exits (per state), the call of the actions and the return
+    const u64 blockLabel = 0;
+    const u64 continuationLabel = 2*stateCount;
+    const u64 stubLabel = 4*stateCount;
+    const u64 exitLabel = 6*stateCount;
+    const u64 actionLabel = 7*stateCount;
+    const u64 returnLabel = actionLabel + 1;
+    Emitter out(base + codeOffset);
+
+    // The code keeps the state pointer in rbx, the end in rbp, the context
+    //   and the action of the lexer in r12 and r13, the entry blocks of the
+    // mode in r14, the classes in r15 (saved across the calls of the action)
+    // and the data in rsi
+    for (u32 m = 0; m < 2; ++m) {
+        // Entry (state pointer in rdi, data in rsi, end in rdx, context in rcx, action in r8)
+        out.bytes("\x53\x55\x41\x54\x41\x55\x41\x56\x41\x57", 10); // push rbx, rbp, r12, r13, r14, r15
+        out.bytes("\x48\x83\xec\x08", 4);                         // sub rsp, 8 (the calls are aligned)
+        out.bytes("\x48\x89\xfb", 3);                             // mov rbx, rdi
+        out.bytes("\x48\x89\xd5", 3);                             // mov rbp, rdx
+        out.bytes("\x49\x89\xcc", 3);                             // mov r12, rcx
+        out.bytes("\x4d\x89\xc5", 3);                             // mov r13, r8
+        out.bytes("\x49\xbf", 2);                                 // mov r15, classes
+        out.imm64(u64(classes));
+        out.bytes("\x49\xbe", 2);                                 // mov r14, entries
+        out.imm64(u64(entries + m*stateCount));
+        // To the block of the state
+        out.bytes("\x48\x8b\x03", 3);                             // mov rax, [rbx]
+        out.bytes("\x41\xff\x24\xc6", 4);                         // jmp [r14 + rax*8]
+    }
+
+    for (u64 index = 0; index < 2*stateCount; ++index) {
+        const u64 stateId = index % stateCount;
+
+        // Block: the next byte and its class
+        out.place(blockLabel + index);
+        out.bytes("\x48\x39\xee", 3);                             // cmp rsi, rbp
+        out.bytes("\x0f\x83", 2);                                 // jae exit
+        out.rel32(exitLabel + stateId);
+        out.bytes("\x0f\xb6\x06", 3);                             // movzx eax, byte [rsi]
+        out.bytes("\x41\x8b\x04\x87", 4);                         // mov eax, [r15 + rax*4]
+
+        if (tables) {
+            out.bytes("\x48\xb9", 2);                             // mov rcx, row
+            out.imm64(u64(rows + index*width));
+            out.bytes("\xff\x24\xc1", 3);                         // jmp [rcx + rax*8]
+            continue;
+        }
+
+        // A branch per state the block continues to: past the byte, to its block
+        const std::vector<std::pair<u64, u64> > &targets = branches[index];
+        for (u32 i = 0; i < targets.size(); ++i) {
+            out.bytes("\x48\xb9", 2);                             // mov rcx, classes of the branch
+            out.imm64(targets[i].first);
+            out.bytes("\x48\x0f\xa3\xc1", 4);                     // bt rcx, rax
+            out.bytes("\x73\x08", 2);                             // jnc next branch
+            out.bytes("\x48\xff\xc6", 3);                         // inc rsi
+            out.bytes("\xe9", 1);                                 // jmp block
+            out.rel32(blockLabel + index - stateId + targets[i].second);
+        }
+        if (actions[stateId]) {
+            // The classes acted on: to the call of the action, the state in edx
+            out.bytes("\x48\xb9", 2);                             // mov rcx, classes acted on
+            out.imm64(actions[stateId]);
+            out.bytes("\x48\x0f\xa3\xc1", 4);                     // bt rcx, rax
+            out.bytes("\x0f\x83", 2);                             // jnc exit
+            out.rel32(exitLabel + stateId);
+            out.bytes("\xba", 1);                                 // mov edx, state
+            out.imm32(u32(stateId));
+            out.bytes("\xe9", 1);                                 // jmp action
+            out.rel32(actionLabel);
+            continue;
+        }
+        out.bytes("\xe9", 1);                                     // jmp exit
+        out.rel32(exitLabel + stateId);
+    }
+
+    // Continuations of the tables: past the byte, to the block
+    for (u64 index = 0; index < 2*stateCount && tables; ++index) {
+        out.place(continuationLabel + index);
+        out.bytes("\x48\xff\xc6", 3);                             // inc rsi
+        out.bytes("\xe9", 1);                                     // jmp block
+        out.rel32(blockLabel + index);
+    }
+
+    // Stubs of the tables: to the call of the action, the state in edx
+    for (u64 index = 0; index < 2*stateCount && tables; ++index) {
+        out.place(stubLabel + index);
+        out.bytes("\xba", 1);                                     // mov edx, state
+        out.imm32(u32(index % stateCount));
+        out.bytes("\xe9", 1);                                     // jmp action
+        out.rel32(actionLabel);
+    }
+
+    // Action (the state in edx, its class in eax): the lexer acts on the byte
+    //   and returns the one to go on from, in the state it stores, or null
+    out.place(actionLabel);
+    out.bytes("\x48\x89\x13", 3);                                 // mov [rbx], rdx
+    out.bytes("\x48\x89\xf1", 3);                                 // mov rcx, rsi
+    out.bytes("\x89\xc2", 2);                                     // mov edx, eax
+    out.bytes("\x48\x89\xde", 3);                                 // mov rsi, rbx
+    out.bytes("\x4c\x89\xe7", 3);                                 // mov rdi, r12
+    out.bytes("\x41\xff\xd5", 3);                                 // call r13
+    out.bytes("\x48\x85\xc0", 3);                                 // test rax, rax
+    out.bytes("\x0f\x84", 2);                                     // jz return
+    out.rel32(returnLabel);
+    out.bytes("\x48\x89\xc6", 3);                                 // mov rsi, rax
+    out.bytes("\x48\x8b\x03", 3);                                 // mov rax, [rbx]
+    out.bytes("\x41\xff\x24\xc6", 4);                             // jmp [r14 + rax*8]
+
+    // Exit: the state and the byte the run stopped at are returned
+    for (u64 stateId = 0; stateId < stateCount; ++stateId) {
+        out.place(exitLabel + stateId);
+        out.bytes("\x48\xc7\x03", 3);                             // mov qword [rbx], state
+        out.imm32(u32(stateId));
+        out.bytes("\x48\x89\xf0", 3);                             // mov rax, rsi
+        out.bytes("\xe9", 1);                                     // jmp return
+        out.rel32(returnLabel);
+    }
+
+    out.place(returnLabel);
+    out.bytes("\x48\x83\xc4\x08", 4);                             // add rsp, 8
+    out.bytes("\x41\x5f\x41\x5e\x41\x5d\x41\x5c\x5d\x5b", 10);   // pop r15, r14, r13, r12, rbp, rbx
+    out.bytes("\xc3", 1);                                         // ret
+    out.resolve();
+
+    for (u64 index = 0; index < 2*stateCount; ++index) {
+        const u64 stateId = index % stateCount;
+        entries[index] = u64(out.address(blockLabel + index));
+
+        const u32 mode = index < stateCount ? Transition::ModeKeep : Transition::ModeSkip;
+        for (u64 classId = 0; classId < width && tables; ++classId) {
+            const Transition &transition = automaton.transition(stateId, classId);
+            const bool runs = transition.action == Transition::ActionContinue && transition.mode == mode;
+            rows[index*width + classId] = u64(out.address(runs ? continuationLabel + index - stateId + transition.state : acts(transition) ? stubLabel + index : exitLabel + stateId));
+        }
+    }
+
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        Ways::diagnostics() << "warning: unable to make native code executable" << std::endl;
+        munmap(code, size);
+        return false;
+    }
+
+    mAutomaton = &automaton;
+    mCode = base;
+    mSize = size;
+    for (u32 m = 0; m < 2; ++m) {
+        mRuns[m] = reinterpret_cast<Run>(base + codeOffset + m*ENTRY_SIZE);
+    }
+    return true;
+#else
+    (void)automaton;
+    (void)limit;
+    Ways::diagnostics() << "warning: native code is compiled for x86-64 only" << std::endl;
+    return false;
+#endif
+}
@@ -0,0 +1,94 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "ways.hpp"
+
+#include <elib/aliases.hpp>
+using namespace elib::aliases;
+
+/**
+ * Native code compiled from the tables of an automaton built in memory,
+ *   for lexers built at runtime from specifications no C++ compiler sees.
+ *
+ * Every state is coded directly: a block of x86-64 code loads the next
+ *   byte, looks its class up and tests it against the classes of every
+ * state it continues to (a jump through a table if there are more than
+ * 64 classes), then goes on in the block of that state. Transitions which
+ * continue keeping or skipping stay in the code. The ones which act on
+ * the byte (tokens, clears, failures) call the lexer back, which acts on
+ * it as it does for the tables, and the code goes on in the block of the
+ * state it stores. Only the transitions continuing in the other mode and
+ * the multibyte characters return to the lexer. So the code is the runs
+ * interface of the lexer (see lexer::HasRuns) and a Jit is an automaton
+ * for it:
+ *     Jit jit;
+ *     if (jit.compile(automaton)) {
+ *         lexer::Lexer<Jit, Handler> lexing(jit, handler);
+ *         ...
+ *     }
+ *
+ * The code is written to anonymous memory which is made executable (and
+ *   read-only) once it is complete. Only byte alphabets (8-bit and UTF-8)
+ * are compiled, on x86-64 only. Handlers must not throw: the code has no
+ * unwind information.
+**/
+class Jit {
+public:
+    typedef Ways::Transition Transition;
+    typedef Ways::Automaton::Char Char;
+    typedef const Char *(*Action)(void *context, u64 *stateId, u64 classId, const Char *data);
+    typedef const Char *(*Run)(u64 *stateId, const Char *data, const Char *end, void *context, Action action);
+
+    static const u64 DEFAULT_LIMIT = u64(64) << 20;  // In bytes of code and rows
+
+public:
+    Jit();
+    ~Jit();
+
+    /**
+     * Compiles @automaton; the code of the previous one is released.
+     *   <convention>@automaton must outlive the code</convention>
+     * Returns false (with a warning) if @automaton cannot be compiled:
+     * the alphabet is wider than bytes, the code would take more than
+     * @limit bytes or the platform is not x86-64.
+    **/
+    bool compile(const Ways::Automaton &automaton, u64 limit = DEFAULT_LIMIT);
+
+    /**
+     * Size of the code and of its rows, in bytes (0 unless compiled)
+    **/
+    u64 size() const { return mSize; }
+
+    // Automaton interface, the one of the automaton compiled
+    u32 initialState() const { return mAutomaton->initialState(); }
+    u32 eosClass() const { return mAutomaton->eosClass(); }
+    u32 classOf(u32 c) const { return mAutomaton->classOf(c); }
+    const Transition &transition(u32 stateId, u32 classId) const { return mAutomaton->transition(stateId, classId); }
+    u32 keyword(u32 token, const Char *lexeme, u32 length) const { return mAutomaton->keyword(token, lexeme, length); }
+
+    // Interning interface
+    typedef u32 Interned;
+    bool interned(u32 tokenId) const { return mAutomaton->interned(tokenId); }
+
+    // Runs interface
+    const Char *run(u32 &stateId, u32 mode, const Char *data, const Char *end, void *context, Action action) const {
+        u64 state = stateId;
+        data = mRuns[mode == Transition::ModeKeep ? 0 : 1](&state, data, end, context, action);
+        stateId = state;
+        return data;
+    }
+
+private:
+    Jit(const Jit &);
+    Jit &operator = (const Jit &);
+
+    void release();
+
+private:
+    const Ways::Automaton *mAutomaton;
+    u8 *mCode;
+    u64 mSize;
+    Run mRuns[2];  // Keeping and skipping
+};
+
+#endif // JIT_HPP
@@ -1,16 +1,200 @@
 #include "ways.hpp"
+#include "batch.hpp"
+#include "cache.hpp"
 
 #include <iostream>
+#include <fstream>
 #include <cstdlib>
+#include <cstring>
+#include <cctype>
 
 #include <elib/aliases.hpp>
 using namespace elib::aliases;
 
 
+static void usage(const char *program) {
+    std::cerr << "usage: " << program << " [--stats[=<file>]] < spec > tables" << std::endl;
+    std::cerr << "       " << program << " --batch[=<list>] [--jobs=<n>]" << std::endl;
+    std::cerr << "  common: [--namespace=<name>] [--alphabet=8|16|32|utf8] [--layout=flat|split] [--stride=1|2 [--stride-limit=<KiB>]] [--cache=<dir> [--cache-size=<MiB>]]" << std::endl;
+    std::cerr << "  --stats    print out generation statistics (JSON) to stderr or <file>" << std::endl;
+    std::cerr << "  --batch    translate every `<spec> <tables>` pair listed in <list> or stdin" << std::endl;
+    std::cerr << "  --jobs     number of specifications translated at once (default: processors)" << std::endl;
+    std::cerr << "  --namespace  namespace of the emitted tables (default: Ways)" << std::endl;
+    std::cerr << "  --alphabet   code units lexed: bytes, UTF-16, UTF-32 or UTF-8 characters (default: 8)" << std::endl;
+    std::cerr << "  --layout     transitions as a table of structs or hot next-state cells with a cold side table (default: flat)" << std::endl;
+    std::cerr << "  --stride     characters per step of the lexer, 2 needs a table of pairs of classes (default: 1)" << std::endl;
+    std::cerr << "  --stride-limit  size cap of the table of pairs, stride 1 beyond it (default: 1024)" << std::endl;
+    std::cerr << "  --cache    reuse tables generated from the same spec, stored in <dir>" << std::endl;
+    std::cerr << "  --cache-size  size cap of the cache (default: 256)" << std::endl;
+}
+
+
+// Checks that @name is a C++ identifier
+static bool identifier(const std::string &name) {
+    if (name.empty() || std::isdigit(u8(name[0]))) {
+        return false;
+    }
+    for (u32 i = 0; i < name.length(); ++i) {
+        if (!std::isalnum(u8(name[i])) && name[i] != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 int main( int argc, char **argv ) {
-    if (Ways::translate(std::cin, std::cout)) {
-        return EXIT_SUCCESS;
-    } else {
+    // Specifications are read by large blocks, not through stdio
+    std::ios::sync_with_stdio(false);
+
+    bool stats = false;
+    const char *statsPath = 0;
+    bool batch = false;
+    const char *batchPath = 0;
+    u32 jobCount = 0;
+    const char *cachePath = 0;
+    u64 cacheSize = Cache::DEFAULT_CAPACITY;
+    Ways::Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else if (std::strncmp(argv[i], "--stats=", 8) == 0) {
+            stats = true;
+            statsPath = argv[i] + 8;
+        } else if (std::strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        } else if (std::strncmp(argv[i], "--batch=", 8) == 0) {
+            batch = true;
+            batchPath = argv[i] + 8;
+        } else if (std::strncmp(argv[i], "--jobs=", 7) == 0) {
+            char *end;
+            const long value = std::strtol(argv[i] + 7, &end, 10);
+            if (*end != '\0' || end == argv[i] + 7 || value <= 0) {
+                std::cerr << "error: invalid number of jobs `" << argv[i] + 7 << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+            jobCount = value;
+        } else if (std::strncmp(argv[i], "--namespace=", 12) == 0) {
+            options.name = argv[i] + 12;
+            if (!identifier(options.name)) {
+                std::cerr << "error: invalid namespace `" << options.name << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (std::strncmp(argv[i], "--alphabet=", 11) == 0) {
+            const char *alphabet = argv[i] + 11;
+            if (std::strcmp(alphabet, "8") == 0) {
+                options.alphabet = Ways::Options::Alphabet8;
+            } else if (std::strcmp(alphabet, "16") == 0) {
+                options.alphabet = Ways::Options::Alphabet16;
+            } else if (std::strcmp(alphabet, "32") == 0) {
+                options.alphabet = Ways::Options::Alphabet32;
+            } else if (std::strcmp(alphabet, "utf8") == 0) {
+                options.alphabet = Ways::Options::AlphabetUtf8;
+            } else {
+                std::cerr << "error: invalid alphabet `" << alphabet << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (std::strncmp(argv[i], "--layout=", 9) == 0) {
+            const char *layout = argv[i] + 9;
+            if (std::strcmp(layout, "flat") == 0) {
+                options.layout = Ways::Options::LayoutFlat;
+            } else if (std::strcmp(layout, "split") == 0) {
+                options.layout = Ways::Options::LayoutSplit;
+            } else {
+                std::cerr << "error: invalid layout `" << layout << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (std::strncmp(argv[i], "--stride=", 9) == 0) {
+            if (std::strcmp(argv[i] + 9, "1") != 0 && std::strcmp(argv[i] + 9, "2") != 0) {
+                std::cerr << "error: invalid stride `" << argv[i] + 9 << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+            options.stride = argv[i][9] - '0';
+        } else if (std::strncmp(argv[i], "--stride-limit=", 15) == 0) {
+            char *end;
+            const long value = std::strtol(argv[i] + 15, &end, 10);
+            if (*end != '\0' || end == argv[i] + 15 || value <= 0) {
+                std::cerr << "error: invalid stride limit `" << argv[i] + 15 << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+            options.strideLimit = u64(value) << 10;
+        } else if (std::strncmp(argv[i], "--cache=", 8) == 0) {
+            cachePath = argv[i] + 8;
+        } else if (std::strncmp(argv[i], "--cache-size=", 13) == 0) {
+            char *end;
+            const long value = std::strtol(argv[i] + 13, &end, 10);
+            if (*end != '\0' || end == argv[i] + 13 || value <= 0) {
+                std::cerr << "error: invalid cache size `" << argv[i] + 13 << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+            cacheSize = u64(value) << 20;
+        } else {
+            std::cerr << "error: unknown option `" << argv[i] << '`' << std::endl;
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Cache *cache = 0;
+    if (cachePath) {
+        if (stats) {
+            // Statistics are measured while the tables are built
+            std::cerr << "error: --stats and --cache may not be used together" << std::endl;
+            return EXIT_FAILURE;
+        }
+        cache = new Cache(cachePath, cacheSize);
+    }
+
+    if (batch) {
+        if (stats) {
+            std::cerr << "error: --stats is not supported in batch mode" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::vector<Batch::Job> jobs;
+        if (batchPath) {
+            std::ifstream list(batchPath);
+            if (!list) {
+                std::cerr << "error: unable to open batch list `" << batchPath << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+            if (!Batch::load(list, jobs)) {
+                return EXIT_FAILURE;
+            }
+        } else if (!Batch::load(std::cin, jobs)) {
+            return EXIT_FAILURE;
+        }
+
+        const bool success = Batch::run(jobs, jobCount, options, cache);
+        delete cache;
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (cache) {
+        const bool success = cache->translate(std::cin, std::cout, options);
+        delete cache;
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Ways::Statistics statistics;
+
+    if (!Ways::translate(std::cin, std::cout, stats ? &statistics : 0, options)) {
         return EXIT_FAILURE;
     }
+
+    if (stats) {
+        if (statsPath) {
+            std::ofstream out(statsPath);
+            statistics.print(out);
+            if (!out) {
+                std::cerr << "error: unable to write statistics to `" << statsPath << '`' << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else {
+            statistics.print(std::cerr);
+        }
+    }
+
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,138 @@
+#include "output.hpp"
+#include <cstring>
+#include <algorithm>
+
+namespace output
+{
+  Buffer::Buffer( std::ostream *stream, u32 capacity )
+    : mStream(stream), mData(capacity > 0 ? capacity : 1), mSize(0)
+  {
+  }
+
+
+  Buffer::~Buffer()
+  {
+    flush();
+  }
+
+
+  void Buffer::append( const char *data, u32 length )
+  {
+    if( mSize + length > mData.size() )
+    {
+      if( mStream )
+      {
+        flush();
+        if( length >= mData.size() )
+        {
+          // Too large to be buffered, it goes right through
+          mStream->write( data, length );
+          return;
+        }
+      } else {
+        mData.resize( std::max<u64>(2 * mData.size(), mSize + length) );
+      }
+    }
+
+    std::memcpy( &mData[mSize], data, length );
+    mSize += length;
+  }
+
+
+  void Buffer::append( const Buffer &buffer )
+  {
+    if( buffer.mSize > 0 )
+      append( &buffer.mData[0], buffer.mSize );
+  }
+
+
+  Buffer &Buffer::operator << ( const char *value )
+  {
+    append( value, std::strlen(value) );
+    return *this;
+  }
+
+
+  Buffer &Buffer::operator << ( const std::string &value )
+  {
+    append( value.data(), value.length() );
+    return *this;
+  }
+
+
+  Buffer &Buffer::operator << ( char value )
+  {
+    if( mSize == mData.size() )
+    {
+      append( &value, 1 );
+    } else {
+      mData[mSize++] = value;
+    }
+    return *this;
+  }
+
+
+  Buffer &Buffer::operator << ( unsigned int value )
+  {
+    number( value );
+    return *this;
+  }
+
+
+  Buffer &Buffer::operator << ( unsigned long value )
+  {
+    number( value );
+    return *this;
+  }
+
+
+  Buffer &Buffer::operator << ( unsigned long long value )
+  {
+    number( value );
+    return *this;
+  }
+
+
+  Buffer &Buffer::operator << ( int value )
+  {
+    if( value < 0 )
+    {
+      *this << '-';
+      number( -(long long)value );
+    } else {
+      number( value );
+    }
+    return *this;
+  }
+
+
+  void Buffer::flush()
+  {
+    if( mStream && mSize > 0 )
+    {
+      mStream->write( &mData[0], mSize );
+      mSize = 0;
+    }
+  }
+
+
+  bool Buffer::ok() const
+  {
+    return mStream == 0 || mStream->good();
+  }
+
+
+  void Buffer::number( unsigned long long value )
+  {
+    char digits[20];
+    u32 begin = sizeof(digits);
+
+    do
+    {
+      digits[--begin] = char('0' + value % 10);
+      value /= 10;
+    } while( value );
+
+    append( digits + begin, sizeof(digits) - begin );
+  }
+}
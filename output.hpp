@@ -0,0 +1,62 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <elib/aliases.hpp>
+
+namespace output
+{
+  using namespace elib::aliases;
+
+  /**
+   * Output buffer for emission of large tables.
+   *   Integers are formatted by hand (no locale, no stream state) and
+   * the text is written to the attached stream by large blocks only.
+   *
+   * A buffer with no stream attached just accumulates the text, it is
+   *   used to format parts of the output in parallel (see append()).
+  **/
+  class Buffer
+  {
+  public:
+    static const u32 DEFAULT_CAPACITY = 1 << 20;
+
+  private:
+    Buffer( const Buffer & );
+    Buffer &operator = ( const Buffer & );
+
+  public:
+    explicit Buffer( std::ostream *stream = 0, u32 capacity = DEFAULT_CAPACITY );
+    ~Buffer();
+
+    void append( const char *data, u32 length );
+    void append( const Buffer &buffer );
+
+    Buffer &operator << ( const char *value );
+    Buffer &operator << ( const std::string &value );
+    Buffer &operator << ( char value );
+    Buffer &operator << ( unsigned int value );
+    Buffer &operator << ( unsigned long value );
+    Buffer &operator << ( unsigned long long value );
+    Buffer &operator << ( int value );
+
+    /**
+     * Writes out the buffered text (if a stream is attached)
+    **/
+    void flush();
+
+    bool ok() const;
+
+  protected:
+    void number( unsigned long long value );
+
+  protected:
+    std::ostream *mStream;
+    std::vector<char> mData;
+    u32 mSize;
+  };
+}
+
+#endif // OUTPUT_HPP
@@ -0,0 +1,149 @@
+#ifndef BOUNDARY_HPP
+#define BOUNDARY_HPP
+
+#include "lexer.hpp"
+
+#include <vector>
+#include <elib/aliases.hpp>
+
+namespace boundary {
+  using namespace elib::aliases;
+
+  /**
+   * Lexes an input into two dense columns instead of a token per call:
+   *   ends: a bit per code unit (byte) of input, bit i % 64 of word i / 64
+   *     is set if a token ends at the code unit i (the last one it consumed,
+   *     a skipped closing quote included),
+   *   ids: ids of the tokens in input order, so the token ending at i is
+   *     ids[number of bits set in ends below i].
+   * Consumers walk the bitmap with popcnt/tzcnt or SIMD.
+   *
+   * A token which consumes nothing after the previous one ends at the same
+   *   code unit: it has no bit of its own, so it is dropped and counted
+   * by mergedCount().
+   *
+   * <convention>@automaton must outlive the splitter</convention>
+  **/
+  template <class Automaton>
+  class Splitter {
+  public:
+    typedef typename Automaton::Char Char;
+    typedef unsigned int Id;  // 32 bits, whatever u32 is
+
+  public:
+    explicit Splitter(const Automaton &automaton);
+
+    void reset();
+
+    /**
+     * Lexes the next block of input.
+     * Returns false if lexing failed (now or before).
+    **/
+    bool feed(const Char *data, u32 length);
+
+    /**
+     * Processes the end of input.
+     * Returns false if lexing failed (now or before).
+    **/
+    bool finish();
+
+    bool ok() const { return mLexer.ok(); }
+    u32 failureId() const { return mFailureId; }
+    u64 failureOffset() const { return mFailureOffset; }
+    const std::vector<lexer::Failure> &recoveries() const { return mRecoveries; }  // In input order
+
+    u64 size() const { return mSize; }  // Code units fed
+    const std::vector<u64> &ends() const { return mEnds; }
+    const std::vector<Id> &ids() const { return mIds; }
+    u64 mergedCount() const { return mMergedCount; }
+
+  private:
+    Splitter(const Splitter &);
+    Splitter &operator = (const Splitter &);
+
+    /**
+     * Handler of the lexer, marks the ends of the tokens
+    **/
+    struct Marker {
+      explicit Marker(Splitter &splitter) : splitter(splitter) {}
+
+      void token(u32 tokenId, u64, const Char *, u32) { splitter.mark(tokenId); }
+
+      void failure(u32 failureId, u64 offset) {
+        splitter.mFailureId = failureId;
+        splitter.mFailureOffset = offset;
+      }
+
+      void recovery(u32 failureId, u64 offset) {
+        const lexer::Failure failure = {failureId, offset};
+        splitter.mRecoveries.push_back(failure);
+      }
+
+      Splitter &splitter;
+    };
+
+    void mark(u32 tokenId);
+
+  private:
+    Marker mMarker;
+    lexer::Lexer<Automaton, Marker> mLexer;
+
+    std::vector<u64> mEnds;
+    std::vector<Id> mIds;
+    u64 mSize;
+    u64 mLastEnd;  // End (past the last code unit) of the last token marked
+    u64 mMergedCount;
+
+    u32 mFailureId;
+    u64 mFailureOffset;
+    std::vector<lexer::Failure> mRecoveries;
+  };
+
+
+  template <class Automaton>
+  Splitter<Automaton>::Splitter(const Automaton &automaton) :
+  mMarker(*this),
+  mLexer(automaton, mMarker) {
+    reset();
+  }
+
+  template <class Automaton>
+  void Splitter<Automaton>::reset() {
+    mLexer.reset();
+    mEnds.clear();
+    mIds.clear();
+    mSize = mLastEnd = mMergedCount = 0;
+    mFailureId = lexer::INVALID_ID;
+    mFailureOffset = 0;
+    mRecoveries.clear();
+  }
+
+  template <class Automaton>
+  bool Splitter<Automaton>::feed(const Char *data, u32 length) {
+    // The bitmap covers the block before it is lexed, so mark() never grows it
+    mSize += length;
+    mEnds.resize((mSize + 63) / 64, 0);
+    return mLexer.feed(data, length);
+  }
+
+  template <class Automaton>
+  bool Splitter<Automaton>::finish() {
+    return mLexer.finish();
+  }
+
+  template <class Automaton>
+  inline void Splitter<Automaton>::mark(u32 tokenId) {
+    const u64 end = mLexer.offset();
+    if (end <= mLastEnd) {
+      mMergedCount++;
+      return;
+    }
+
+    const u64 last = end - 1;
+    mEnds[last / 64] |= u64(1) << (last % 64);
+    mIds.push_back(Id(tokenId));
+    mLastEnd = end;
+  }
+}  // namespace boundary
+
+#endif // BOUNDARY_HPP
@@ -0,0 +1,130 @@
+#ifndef CLASSIFIER_HPP
+#define CLASSIFIER_HPP
+
+#include "lexer.hpp"
+
+#include <cstring>
+#include <elib/aliases.hpp>
+#ifdef __SSSE3__
+  #include <tmmintrin.h>
+#endif
+
+namespace classifier {
+  using namespace elib::aliases;
+
+  /**
+   * Automaton of a byte alphabet (8-bit or UTF-8) with the classes interface
+   *   of the lexer (see lexer::HasClasses): the classes of a whole block of
+   * input are looked up first, then the lexer follows the transitions over
+   * them, so no class lookup is on the chain of dependent transitions.
+   *     classifier::Classifier<Automaton> classes(automaton);
+   *     if (classes.fits()) {
+   *       lexer::Lexer<classifier::Classifier<Automaton>, Handler> lexing(classes, handler);
+   *       ...
+   *     }
+   *
+   * The class map is split by nibbles: bytes of the same high nibble are
+   *   a row of 16 classes, equal rows are a group. With SSSE3 a block is
+   * classified 16 bytes at a time by shuffles: of the groups by the high
+   * nibbles, then of every group's row by the low nibbles. Without it,
+   * the classes are looked up in a byte copy of the class map.
+   *
+   * <convention>@automaton must outlive the classifier</convention>
+  **/
+  template <class Automaton>
+  class Classifier {
+  public:
+    typedef typename Automaton::Transition Transition;
+    typedef typename Automaton::Char Char;
+    typedef u8 Class;
+
+  public:
+    explicit Classifier(const Automaton &automaton);
+
+    /**
+     * Whether all the classes of bytes fit a Class: the lexer may use
+     *   the classifier only if they do
+    **/
+    bool fits() const { return mFits; }
+
+    // Automaton interface, the one of the automaton classified
+    u32 initialState() const { return mAutomaton.initialState(); }
+    u32 eosClass() const { return mAutomaton.eosClass(); }
+    u32 classOf(u32 c) const { return mClasses[u8(c)]; }
+    const Transition &transition(u32 stateId, u32 classId) const { return mAutomaton.transition(stateId, classId); }
+    u32 keyword(u32 token, const Char *lexeme, u32 length) const { return mAutomaton.keyword(token, lexeme, length); }
+
+    // Classes interface
+    void classify(const Char *data, u32 length, Class *classes) const;
+
+  private:
+    const Automaton &mAutomaton;
+    u8 mClasses[256];
+    u8 mGroupOf[16];    // Group of the row of every high nibble
+    u8 mRows[16][16];   // Row of every group
+    u32 mGroupCount;
+    bool mFits;
+  };
+
+
+  template <class Automaton>
+  Classifier<Automaton>::Classifier(const Automaton &automaton) :
+  mAutomaton(automaton),
+  mGroupCount(0),
+  mFits(true) {
+    for (u32 c = 0; c < 256; ++c) {
+      const u32 classId = automaton.classOf(u8(c));
+      mFits = mFits && classId <= 0xff;
+      mClasses[c] = u8(classId);
+    }
+
+    for (u32 high = 0; high < 16; ++high) {
+      const u8 *const row = mClasses + high * 16;
+      u32 group = 0;
+      while (group < mGroupCount && std::memcmp(mRows[group], row, 16) != 0) {
+        ++group;
+      }
+      if (group == mGroupCount) {
+        std::memcpy(mRows[mGroupCount++], row, 16);
+      }
+      mGroupOf[high] = u8(group);
+    }
+  }
+
+  template <class Automaton>
+  void Classifier<Automaton>::classify(const Char *data, u32 length, Class *classes) const {
+    u32 i = 0;
+
+#ifdef __SSSE3__
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i groupOf = _mm_loadu_si128(reinterpret_cast<const __m128i *>(mGroupOf));
+    // Rows but the first one are differences from it: a byte is of one group only
+    const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(mRows[0]));
+    __m128i rows[16];
+    __m128i ids[16];
+    for (u32 group = 1; group < mGroupCount; ++group) {
+      rows[group] = _mm_xor_si128(first, _mm_loadu_si128(reinterpret_cast<const __m128i *>(mRows[group])));
+      ids[group] = _mm_set1_epi8(char(group));
+    }
+
+    for (; i + 16 <= length; i += 16) {
+      const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      const __m128i low = _mm_and_si128(chunk, nibble);
+      const __m128i groups = _mm_shuffle_epi8(groupOf, _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble));
+
+      __m128i result = _mm_shuffle_epi8(first, low);
+      for (u32 group = 1; group < mGroupCount; ++group) {
+        const __m128i selected = _mm_cmpeq_epi8(groups, ids[group]);
+        result = _mm_xor_si128(result, _mm_and_si128(selected, _mm_shuffle_epi8(rows[group], low)));
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(classes + i), result);
+    }
+#endif
+
+    for (; i < length; ++i) {
+      classes[i] = mClasses[u8(data[i])];
+    }
+  }
+}  // namespace classifier
+
+#endif // CLASSIFIER_HPP
@@ -0,0 +1,195 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include "lexer.hpp"
+
+#include <string>
+#include <vector>
+#include <elib/aliases.hpp>
+
+namespace generator {
+  using namespace elib::aliases;
+
+  /**
+   * Outcome of Generator::next()
+  **/
+  enum Status {
+    Ready,    // A token is taken
+    Starved,  // The block is lexed: the next one is expected (or the end of input)
+    Done,     // The input is lexed
+    Failed    // Lexing failed, the tokens before the failure are taken
+  };
+
+  /**
+   * Tokens pulled one at a time, for a caller which cannot be called back:
+   *   an event loop interleaving lexing with reads of the input.
+   *     for (;;) {
+   *       switch (tokens.next(token, lexeme)) {
+   *       case generator::Ready:
+   *         ...
+   *         break;
+   *       case generator::Starved:
+   *         // Once the next block is read
+   *         length > 0 ? tokens.feed(data, length) : tokens.close();
+   *         break;
+   *       ...
+   *     }
+   *
+   * The state of lexing between two calls is the generator itself: a block
+   *   is lexed by slices of @sliceSize code units as the tokens are taken,
+   * so the tokens pending are a slice worth at most. Their queue and
+   * lexemes keep their storage once drained: when they reach the size
+   * a slice needs, lexing allocates no more.
+   *
+   * <convention>@automaton must outlive the generator, a block fed must
+   *   stay until next() returns Starved</convention>
+  **/
+  template <class Automaton>
+  class Generator {
+  public:
+    typedef typename Automaton::Char Char;
+
+    static const u32 DEFAULT_SLICE_SIZE = 4 << 10;
+
+  public:
+    explicit Generator(const Automaton &automaton, u32 sliceSize = DEFAULT_SLICE_SIZE);
+
+    void reset();
+
+    /**
+     * Hands the next block of input, once next() returned Starved
+    **/
+    void feed(const Char *data, u32 length);
+
+    /**
+     * Marks the end of input, once next() returned Starved
+    **/
+    void close();
+
+    /**
+     * Takes the next token into @token, @lexeme points to its characters
+     *   until the next call.
+     * Returns Ready if a token is taken, or why there is none.
+    **/
+    Status next(lexer::Token &token, const Char *&lexeme);
+
+    u32 failureId() const { return mFailureId; }
+    u64 failureOffset() const { return mFailureOffset; }
+    u64 recoveryCount() const { return mLexer.recoveryCount(); }
+
+  private:
+    Generator(const Generator &);
+    Generator &operator = (const Generator &);
+
+    struct Entry {
+      lexer::Token token;
+      u32 lexeme;  // Index into the lexemes of the slice
+    };
+
+    /**
+     * Handler of the lexer, queues the tokens of a slice
+    **/
+    struct Queue {
+      explicit Queue(Generator &generator) : generator(generator) {}
+
+      void token(u32 tokenId, u64 offset, const Char *lexeme, u32 length) {
+        Entry entry;
+        entry.token.id = tokenId;
+        entry.token.length = length;
+        entry.token.offset = offset;
+        entry.lexeme = generator.mLexemes.size();
+        generator.mEntries.push_back(entry);
+        generator.mLexemes.append(lexeme, length);
+      }
+
+      void failure(u32 failureId, u64 offset) {
+        generator.mFailureId = failureId;
+        generator.mFailureOffset = offset;
+      }
+
+      Generator &generator;
+    };
+
+  private:
+    Queue mQueue;
+    lexer::Lexer<Automaton, Queue> mLexer;
+    u32 mSliceSize;
+
+    std::vector<Entry> mEntries;
+    std::basic_string<Char> mLexemes;
+    u32 mHead;  // Next entry to take
+
+    const Char *mData;  // Rest of the block
+    u32 mLength;
+    bool mClosed;
+    bool mFinished;
+
+    u32 mFailureId;
+    u64 mFailureOffset;
+  };
+
+
+  template <class Automaton>
+  Generator<Automaton>::Generator(const Automaton &automaton, u32 sliceSize) :
+  mQueue(*this),
+  mLexer(automaton, mQueue),
+  mSliceSize(sliceSize > 0 ? sliceSize : DEFAULT_SLICE_SIZE) {
+    reset();
+  }
+
+  template <class Automaton>
+  void Generator<Automaton>::reset() {
+    mLexer.reset();
+    mEntries.clear();
+    mLexemes.clear();
+    mHead = 0;
+    mData = 0;
+    mLength = 0;
+    mClosed = mFinished = false;
+    mFailureId = lexer::INVALID_ID;
+    mFailureOffset = 0;
+  }
+
+  template <class Automaton>
+  void Generator<Automaton>::feed(const Char *data, u32 length) {
+    mData = data;
+    mLength = length;
+  }
+
+  template <class Automaton>
+  void Generator<Automaton>::close() {
+    mClosed = true;
+  }
+
+  template <class Automaton>
+  Status Generator<Automaton>::next(lexer::Token &token, const Char *&lexeme) {
+    // The next slice is lexed once the tokens of the previous one are taken
+    while (mHead == mEntries.size()) {
+      mEntries.clear();
+      mLexemes.clear();
+      mHead = 0;
+
+      if (!mLexer.ok()) {
+        return Failed;
+      }
+      if (mLength > 0) {
+        const u32 length = mLength < mSliceSize ? mLength : mSliceSize;
+        mLexer.feed(mData, length);
+        mData += length;
+        mLength -= length;
+      } else if (mClosed && !mFinished) {
+        mFinished = true;
+        mLexer.finish();
+      } else {
+        return mFinished ? Done : Starved;
+      }
+    }
+
+    const Entry &entry = mEntries[mHead++];
+    token = entry.token;
+    lexeme = mLexemes.data() + entry.lexeme;
+    return Ready;
+  }
+}  // namespace generator
+
+#endif // GENERATOR_HPP
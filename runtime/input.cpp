@@ -0,0 +1,135 @@
+#include "input.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace input {
+  Prefetcher::Prefetcher(int fd, u32 blockSize, u32 depth) :
+  mFd(fd),
+  mBlocks(depth < 2 ? 2 : depth),
+  mHead(0),
+  mTail(0),
+  mFilled(0),
+  mHolding(false),
+  mEnd(false),
+  mError(false),
+  mStop(false),
+  mStarted(false) {
+    for (u32 i = 0; i < mBlocks.size(); ++i) {
+      mBlocks[i].data.resize(blockSize);
+      mBlocks[i].length = 0;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    pthread_mutex_init(&mMutex, 0);
+    pthread_cond_init(&mFilledCond, 0);
+    pthread_cond_init(&mReleasedCond, 0);
+    mStarted = pthread_create(&mThread, 0, run, this) == 0;
+    if (!mStarted) {
+      mError = mEnd = true;
+    }
+  }
+
+  Prefetcher::~Prefetcher() {
+    pthread_mutex_lock(&mMutex);
+    mStop = true;
+    pthread_cond_signal(&mReleasedCond);
+    pthread_mutex_unlock(&mMutex);
+
+    if (mStarted) {
+      pthread_join(mThread, 0);
+    }
+
+    pthread_cond_destroy(&mReleasedCond);
+    pthread_cond_destroy(&mFilledCond);
+    pthread_mutex_destroy(&mMutex);
+  }
+
+  bool Prefetcher::next(const char *&data, u32 &length) {
+    pthread_mutex_lock(&mMutex);
+
+    if (mHolding) {
+      mHolding = false;
+      mHead = (mHead + 1) % mBlocks.size();
+      mFilled--;
+      pthread_cond_signal(&mReleasedCond);
+    }
+
+    while (mFilled == 0 && !mEnd) {
+      pthread_cond_wait(&mFilledCond, &mMutex);
+    }
+
+    bool success = false;
+    if (mFilled > 0) {
+      Block &block = mBlocks[mHead];
+      data = &block.data[0];
+      length = block.length;
+      mHolding = true;
+      success = true;
+    }
+
+    pthread_mutex_unlock(&mMutex);
+    return success;
+  }
+
+  bool Prefetcher::ok() const {
+    return !mError;
+  }
+
+  void *Prefetcher::run(void *self) {
+    static_cast<Prefetcher *>(self)->read();
+    return 0;
+  }
+
+  void Prefetcher::read() {
+    for (;;) {
+      pthread_mutex_lock(&mMutex);
+      while (mFilled == mBlocks.size() && !mStop) {
+        pthread_cond_wait(&mReleasedCond, &mMutex);
+      }
+      if (mStop) {
+        pthread_mutex_unlock(&mMutex);
+        return;
+      }
+      Block &block = mBlocks[mTail];
+      pthread_mutex_unlock(&mMutex);
+
+      // Only a full block is handed out, short reads are continued
+      u32 length = 0;
+      bool end = false;
+      bool error = false;
+      while (length < block.data.size()) {
+        const ssize_t count = ::read(mFd, &block.data[length], block.data.size() - length);
+        if (count > 0) {
+          length += count;
+        } else if (count < 0 && errno == EINTR) {
+          continue;
+        } else {
+          error = count < 0;
+          end = true;
+          break;
+        }
+      }
+
+      pthread_mutex_lock(&mMutex);
+      if (length > 0) {
+        block.length = length;
+        mTail = (mTail + 1) % mBlocks.size();
+        mFilled++;
+      }
+      mEnd = end;
+      mError = error;
+      pthread_cond_signal(&mFilledCond);
+      const bool stop = mEnd || mStop;
+      pthread_mutex_unlock(&mMutex);
+
+      if (stop) {
+        return;
+      }
+    }
+  }
+}  // namespace input
@@ -0,0 +1,101 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <pthread.h>
+#include <vector>
+#include <elib/aliases.hpp>
+
+namespace input {
+  using namespace elib::aliases;
+
+  /**
+   * Hands out an input which is already in memory by blocks of @blockSize bytes
+   *   (the same interface as Prefetcher has).
+  **/
+  class Buffer {
+  public:
+    Buffer(const char *data, u64 length, u32 blockSize = 1 << 20) :
+    mData(data),
+    mEnd(data + length),
+    mBlockSize(blockSize) {}
+
+    bool next(const char *&data, u32 &length) {
+      if (mData == mEnd) {
+        return false;
+      }
+      data = mData;
+      length = u64(mEnd - mData) < mBlockSize ? u32(mEnd - mData) : mBlockSize;
+      mData += length;
+      return true;
+    }
+
+    bool ok() const { return true; }
+
+  private:
+    const char *mData;
+    const char *mEnd;
+    u32 mBlockSize;
+  };
+
+  /**
+   * Reads a file ahead of the lexer.
+   *   A background thread fills a ring of @depth blocks while the lexer
+   * works on the block returned by the last call of next(), so the
+   * lexing loop does not stall on `read`.
+   *
+   * Blocks are handed out in place (no copying) and stay valid until
+   *   the following call of next().
+  **/
+  class Prefetcher {
+  public:
+    static const u32 DEFAULT_BLOCK_SIZE = 1 << 20;
+    static const u32 DEFAULT_DEPTH = 2;
+
+  public:
+    /**
+     * <convention>@fd must be open for reading and stay open during the lifetime of the prefetcher</convention>
+    **/
+    Prefetcher(int fd, u32 blockSize = DEFAULT_BLOCK_SIZE, u32 depth = DEFAULT_DEPTH);
+    ~Prefetcher();
+
+    /**
+     * Waits for the next block of input and gives the previous one back to the reader.
+     *   Every block but the last one is full (of @blockSize bytes).
+     * Returns false at the end of input or on a read error (see ok()).
+    **/
+    bool next(const char *&data, u32 &length);
+
+    bool ok() const;
+
+  private:
+    Prefetcher(const Prefetcher &);
+    Prefetcher &operator = (const Prefetcher &);
+
+    static void *run(void *self);
+    void read();
+
+  private:
+    struct Block {
+      std::vector<char> data;
+      u32 length;
+    };
+
+    int mFd;
+    std::vector<Block> mBlocks;
+    u32 mHead;    // The block given to the lexer (or the next one)
+    u32 mTail;    // The block being filled
+    u32 mFilled;  // Filled blocks including the one given to the lexer
+    bool mHolding;
+    bool mEnd;
+    bool mError;
+    bool mStop;
+    bool mStarted;
+
+    pthread_t mThread;
+    pthread_mutex_t mMutex;
+    pthread_cond_t mFilledCond;
+    pthread_cond_t mReleasedCond;
+  };
+}  // namespace input
+
+#endif // INPUT_HPP
@@ -0,0 +1,797 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include "symbols.hpp"
+
+#include <string>
+#include <algorithm>
+#include <elib/aliases.hpp>
+
+namespace lexer {
+  using namespace elib::aliases;
+
+  const u32 INVALID_ID = u32(-1);
+
+  /**
+   * Code of the character @c: characters are unsigned whatever the type
+  **/
+  template <class Char>
+  inline u32 code(Char c) { return c; }
+  inline u32 code(char c) { return u8(c); }
+
+  /**
+   * Whether @Automaton has the stride-2 interface: tables of pairs of
+   *   characters (see Lexer::feed())
+   *     typedef ... Pair;
+   *     u32 pair(u32 stateId, u32 firstClass, u32 secondClass) const;
+   *   a pair is zero unless both characters continue keeping or skipping,
+   * otherwise it is state << 4 | first mode << 2 | second mode.
+  **/
+  template <class Automaton>
+  struct HasPairs {
+    template <class T> static char test(typename T::Pair *);
+    template <class T> static long test(...);
+    static const bool value = sizeof(test<Automaton>(0)) == 1;
+  };
+
+  /**
+   * Whether @Automaton has the runs interface: it follows the transitions
+   *   which continue in the same mode by itself (see Jit)
+   *     typedef ... Run;
+   *     typedef const Char *(*Action)(void *context, u64 *stateId, u64 classId, const Char *data);
+   *     const Char *run(u32 &stateId, u32 mode, const Char *data, const Char *end, void *context, Action action) const;
+   *   run() follows the transitions from @stateId while they continue
+   * keeping (or skipping, as @mode says) and returns the character it
+   * stopped at, the end of input at most; @stateId is the state there.
+   * On the way, it hands the transitions acting on a whole character to
+   * @action (with @context), which returns the character to go on from
+   * (*@stateId is the state there), or null if lexing fails: run() then
+   * returns null too.
+  **/
+  template <class Automaton>
+  struct HasRuns {
+    template <class T> static char test(typename T::Run *);
+    template <class T> static long test(...);
+    static const bool value = sizeof(test<Automaton>(0)) == 1;
+  };
+
+  /**
+   * Whether @Automaton has the classes interface: it classifies a block
+   *   of input at once (see classifier::Classifier)
+   *     typedef ... Class;
+   *     void classify(const Char *data, u32 length, Class *classes) const;
+   *   the lexer then follows the transitions over the classes stored.
+  **/
+  template <class Automaton>
+  struct HasClasses {
+    template <class T> static char test(typename T::Class *);
+    template <class T> static long test(...);
+    static const bool value = sizeof(test<Automaton>(0)) == 1;
+  };
+
+  /**
+   * Whether @Automaton has the sync interface: characters past which lexing
+   *   is in a known state with no lexeme, whatever the input before (see
+   * `sync(...)` of specifications)
+   *     typedef ... Sync;
+   *     u32 syncState() const;  // INVALID_ID if there is none
+   *     const Char *sync(const Char *data, const Char *end) const;
+   *   sync() returns the character past the next synchronizing one, @end
+   * if there is none. Input split past them is lexed part by part (each
+   * one from syncState(), see Lexer::reset()) as it is lexed as a whole.
+  **/
+  template <class Automaton>
+  struct HasSync {
+    template <class T> static char test(typename T::Sync *);
+    template <class T> static long test(...);
+    static const bool value = sizeof(test<Automaton>(0)) == 1;
+  };
+
+  /**
+   * Whether @Automaton has the interning interface: lexemes of some tokens
+   *   are interned as they are lexed (see `intern` of specifications)
+   *     typedef ... Interned;
+   *     bool interned(u32 tokenId) const;
+  **/
+  template <class Automaton>
+  struct HasInterned {
+    template <class T> static char test(typename T::Interned *);
+    template <class T> static long test(...);
+    static const bool value = sizeof(test<Automaton>(0)) == 1;
+  };
+
+  /**
+   * Whether @Handler takes interned tokens by their symbol ids (see
+   *   Lexer::intern()):
+   *     void symbol(u32 tokenId, u64 offset, u32 length, u32 symbolId);
+  **/
+  template <class Handler>
+  struct HasSymbols {
+    template <class T, void (T::*)(u32, u64, u32, u32)> struct Member {};
+    template <class T> static char test(Member<T, &T::symbol> *);
+    template <class T> static long test(...);
+    static const bool value = sizeof(test<Handler>(0)) == 1;
+  };
+
+  /**
+   * Whether @Handler is told about the failures lexing recovers from:
+   *     void recovery(u32 failureId, u64 offset);
+  **/
+  template <class Handler>
+  struct HasRecovery {
+    template <class T, void (T::*)(u32, u64)> struct Member {};
+    template <class T> static char test(Member<T, &T::recovery> *);
+    template <class T> static long test(...);
+    static const bool value = sizeof(test<Handler>(0)) == 1;
+  };
+
+  /**
+   * Token as stored by the runtime components (the lexeme is left in the input)
+  **/
+  struct Token {
+    u32 id;
+    u32 length;
+    u64 offset;
+  };
+
+  /**
+   * Failure lexing recovered from, as stored by the runtime components
+  **/
+  struct Failure {
+    u32 id;
+    u64 offset;
+  };
+
+  /**
+   * Streaming lexer driven by tables of @Automaton.
+   *
+   * @Automaton is either Ways::Automaton (tables built in memory), Jit
+   *   (native code compiled from them), classifier::Classifier (of either
+   * one) or `struct Automaton` of a generated lexer; it must provide:
+   *     typedef ... Transition;
+   *     typedef ... Char;  // Code unit of the alphabet: char, u16 or unsigned int
+   *     u32 initialState() const;
+   *     u32 eosClass() const;
+   *     u32 classOf(Char c) const;  // Or any type @c converts to
+   *     const Transition &transition(u32 stateId, u32 classId) const;
+   *     u32 keyword(u32 token, const Char *lexeme, u32 length) const;
+   *
+   * @Handler must provide:
+   *     void token(u32 tokenId, u64 offset, const Char *lexeme, u32 length);
+   *     void failure(u32 failureId, u64 offset);
+   *   where @failureId is INVALID_ID for an unexpected character (no transition).
+   *   Offsets and lengths are counted in code units.
+   *
+   * A failure with a next state (ActionRecover) does not end lexing: the
+   *   lexeme is dropped, the mode applies to the character and lexing goes
+   * on in the next state, which skips up to where it resumes. @Handler is
+   * told about it if it provides (see HasRecovery):
+   *     void recovery(u32 failureId, u64 offset);
+   *   recoveryCount() counts them either way.
+   *
+   * If both @Automaton and @Handler intern (see HasInterned and HasSymbols),
+   *   the hash of the lexeme is computed as its characters are kept: a token
+   * interned is looked up in the symbol table given to intern() and handed
+   * to symbol() instead of token(). Lexers which do not intern hash nothing.
+   *
+   * Input may be fed by blocks of any size, the blocks are not copied:
+   *   only the characters of the current lexeme are kept between calls.
+   *
+   * Transitions which leave a character (or the end of input) and come back
+   *   to a state they already left it in would loop forever: the character
+   * is unexpected then.
+   *
+   * Tables of UTF-8 alphabets read a multibyte character byte by byte: its
+   *   leading bytes are pending (ModePend) until the last one decides what
+   * happens to the whole character (ModeKeepPending, ModeSkipPending and
+   * ModeLeavePending, the last one lexes the pending bytes again). A malformed
+   * character is left pending too, even by the end of input: its bytes are
+   * lexed again as stray ones.
+  **/
+  template <class Automaton, class Handler>
+  class Lexer {
+  public:
+    typedef typename Automaton::Transition Transition;
+    typedef typename Automaton::Char Char;
+
+  public:
+    Lexer(const Automaton &automaton, Handler &handler);
+
+    void reset();
+
+    /**
+     * Restarts lexing in @stateId with no lexeme: a part of a split input
+     *   is lexed from the state its synchronizing character brings to
+     * (see HasSync).
+    **/
+    void reset(u32 stateId);
+
+    /**
+     * Lexes the next block of input.
+     * Returns false if lexing failed (now or before).
+    **/
+    bool feed(const Char *data, u32 length);
+
+    /**
+     * Processes the end of input.
+     * Returns false if lexing failed (now or before).
+    **/
+    bool finish();
+
+    bool ok() const { return mOk; }
+    u32 state() const { return mState; }
+    u64 offset() const { return mOffset; }
+    u32 lexemeLength() const { return mLexeme.length(); }
+    u64 recoveryCount() const { return mRecoveryCount; }
+
+    /**
+     * Interns lexemes of the interned tokens into @table from now on
+     *   (none if null, the default).
+     * <convention>@table must outlive lexing</convention>
+    **/
+    void intern(symbols::Table<Char> *table) { mSymbols = table; }
+
+  private:
+    Lexer(const Lexer &);
+    Lexer &operator = (const Lexer &);
+
+    template <u32 N>
+    struct Stride {};
+
+    /**
+     * Lexes a block of input a character (or, with the stride-2 interface,
+     *   a pair of characters, with the runs interface, a run of them) per step
+    **/
+    bool feed(const Char *data, u32 length, Stride<1>);
+    bool feed(const Char *data, u32 length, Stride<2>);
+    bool feed(const Char *data, u32 length, Stride<0>);
+
+    template <bool Classifies>
+    struct Classes {};
+
+    /**
+     * Lexes a block of input a character per step, with the classes interface
+     *   the classes of a slice of the block are looked up before the steps
+    **/
+    bool feed(const Char *data, u32 length, Classes<false>);
+    bool feed(const Char *data, u32 length, Classes<true>);
+
+    /**
+     * Lexes the character at @data (of class @classId if given, moves @data
+     *   forward unless it is left).
+     * Returns false if lexing fails.
+    **/
+    bool step(const Char *&data);
+    bool step(const Char *&data, u32 classId);
+
+    /**
+     * Applies the mode of @transition to the character at @data
+     *   (moves @data forward unless the mode is ModeLeave).
+     * <convention>@data is null at the end of input</convention>
+    **/
+    void consume(const Transition &transition, const Char *&data);
+
+    /**
+     * Applies the modes of multibyte characters, out of the hot path.
+    **/
+    void consumePending(const Transition &transition, const Char *&data);
+
+    /**
+     * Lexes the pending bytes again (from the current state).
+    **/
+    void replay();
+
+    /**
+     * Acts on the character at @data for a run of the runs interface (@lexer
+     *   is the context, see HasRuns): the characters of the run before it are
+     * kept or skipped first.
+    **/
+    static const Char *runAction(void *lexer, u64 *stateId, u64 classId, const Char *data);
+
+    /**
+     * Keeps or skips the characters of the current run up to @data
+    **/
+    void runTo(const Char *data);
+
+    /**
+     * Checks that the character at the current offset is not left forever:
+     *   the states it is left in are compared to a saved one, saved again
+     * after every power of two of them (Brent's algorithm, the number of
+     * states is not needed). A loop is an unexpected character.
+     * Returns false if lexing fails.
+    **/
+    bool leave();
+
+    /**
+     * Applies the action of @transition (and its mode via consume()).
+     * Returns false if lexing fails.
+    **/
+    bool act(const Transition &transition, const Char *&data);
+
+    template <bool Listens>
+    struct Recovery {};
+
+    /**
+     * Tells @Handler about a failure recovered from, if it listens
+    **/
+    void recover(u32 failureId, u64 offset, Recovery<true>);
+    void recover(u32, u64, Recovery<false>) {}
+
+    template <bool Interns>
+    struct Interning {};
+
+    static const bool INTERNS = HasInterned<Automaton>::value && HasSymbols<Handler>::value;
+
+    /**
+     * Appends characters to the lexeme, folding them into its hash if
+     *   the lexer interns
+    **/
+    void keep(Char c);
+    void keep(const Char *data, u32 length);
+    void hash(Char c, Interning<true>) { mHash = symbols::hash(mHash, c); }
+    void hash(Char, Interning<false>) {}
+
+    void clearLexeme();
+
+    /**
+     * Hands the lexeme as the token @tokenId to @Handler, by its symbol id
+     *   if the token is interned
+    **/
+    void token(u32 tokenId, Interning<true>);
+    void token(u32 tokenId, Interning<false>);
+
+  private:
+    const Automaton &mAutomaton;
+    Handler &mHandler;
+    std::basic_string<Char> mLexeme;
+    symbols::Hash mHash;  // Of the lexeme, if the lexer interns
+    symbols::Table<Char> *mSymbols;
+    Char mPending[4];     // Leading bytes of the current character
+    u32 mPendingLength;
+    u64 mBegin;   // Offset of the first character of the lexeme
+    u64 mOffset;  // Offset of the current character
+    u32 mState;
+    bool mOk;
+    u64 mRecoveryCount;
+    u64 mLeftOffset;  // Of the character left last (see leave())
+    u32 mLeftState;
+    u32 mLeftCount;
+    u32 mLeftPower;
+    const Char *mRunStart;  // Of the characters of the current run not kept or skipped yet
+    u32 mRunMode;
+  };
+
+
+  template <class Automaton, class Handler>
+  Lexer<Automaton, Handler>::Lexer(const Automaton &automaton, Handler &handler) :
+  mAutomaton(automaton),
+  mHandler(handler),
+  mSymbols(0) {
+    reset();
+  }
+
+  template <class Automaton, class Handler>
+  void Lexer<Automaton, Handler>::reset() {
+    reset(mAutomaton.initialState());
+  }
+
+  template <class Automaton, class Handler>
+  void Lexer<Automaton, Handler>::reset(u32 stateId) {
+    clearLexeme();
+    mPendingLength = 0;
+    mBegin = mOffset = 0;
+    mState = stateId;
+    mOk = true;
+    mRecoveryCount = 0;
+    mLeftOffset = u64(-1);
+  }
+
+  template <class Automaton, class Handler>
+  bool Lexer<Automaton, Handler>::feed(const Char *data, u32 length) {
+    if (!mOk) {
+      return false;
+    }
+    return feed(data, length, Stride<HasRuns<Automaton>::value ? 0 : HasPairs<Automaton>::value ? 2 : 1>());
+  }
+
+  template <class Automaton, class Handler>
+  inline bool Lexer<Automaton, Handler>::feed(const Char *data, u32 length, Stride<1>) {
+    return feed(data, length, Classes<HasClasses<Automaton>::value>());
+  }
+
+  template <class Automaton, class Handler>
+  bool Lexer<Automaton, Handler>::feed(const Char *data, u32 length, Classes<false>) {
+    const Char *const end = data + length;
+
+    while (data < end) {
+      if (!step(data)) {
+        return false;
+      }
+    }
+
+    // Unless replay() failed
+    return mOk;
+  }
+
+  template <class Automaton, class Handler>
+  bool Lexer<Automaton, Handler>::feed(const Char *data, u32 length, Classes<true>) {
+    // Classes of a slice stay in the first level of cache while they are lexed
+    const u32 SLICE_SIZE = 1 << 10;
+    typename Automaton::Class classes[SLICE_SIZE];
+    const Char *const end = data + length;
+
+    while (data < end) {
+      const Char *const slice = data;
+      const Char *const sliceEnd = u32(end - data) > SLICE_SIZE ? data + SLICE_SIZE : end;
+      mAutomaton.classify(slice, sliceEnd - slice, classes);
+
+      while (data < sliceEnd) {
+        if (!step(data, classes[data - slice])) {
+          return false;
+        }
+      }
+    }
+
+    // Unless replay() failed
+    return mOk;
+  }
+
+  template <class Automaton, class Handler>
+  bool Lexer<Automaton, Handler>::feed(const Char *data, u32 length, Stride<2>) {
+    const Char *const end = data + length;
+
+    // A load of the state per two characters; a pair which does something
+    //   else than keeping or skipping is lexed by single steps
+    while (end - data >= 2) {
+      const u32 pair = mAutomaton.pair(mState, mAutomaton.classOf(code(data[0])), mAutomaton.classOf(code(data[1])));
+      if (pair == 0) {
+        if (!step(data)) {
+          return false;
+        }
+        continue;
+      }
+
+      if ((pair >> 2 & 3) == Transition::ModeKeep) {
+        if (mLexeme.empty()) {
+          mBegin = mOffset;
+        }
+        keep(data[0]);
+      }
+      if ((pair & 3) == Transition::ModeKeep) {
+        if (mLexeme.empty()) {
+          mBegin = mOffset + 1;
+        }
+        keep(data[1]);
+      }
+      mState = pair >> 4;
+      data += 2;
+      mOffset += 2;
+    }
+
+    return feed(data, end - data, Stride<1>());
+  }
+
+  template <class Automaton, class Handler>
+  bool Lexer<Automaton, Handler>::feed(const Char *data, u32 length, Stride<0>) {
+    const Char *const end = data + length;
+    // Mode of the run the last character continued, if any
+    u32 run = INVALID_ID;
+
+    while (data < end) {
+      const Transition &transition = mAutomaton.transition(mState, mAutomaton.classOf(code(*data)));
+
+      // The second character of a run goes on with the rest of it (most
+      //   runs of one character are not worth a call): the kept characters
+      // are contiguous in the block, so they are appended at once
+      if (transition.action == Transition::ActionContinue && transition.mode == run) {
+        mRunStart = data;
+        mRunMode = run;
+        data = mAutomaton.run(mState, run, data, end, this, &Lexer::runAction);
+        if (data == 0) {
+          return false;
+        }
+        runTo(data);
+        run = INVALID_ID;
+        continue;
+      }
+
+      mState = transition.state;
+      if (transition.action != Transition::ActionContinue) {
+        run = INVALID_ID;
+        if (!act(transition, data)) {
+          return false;
+        }
+        continue;
+      }
+
+      run = transition.mode == Transition::ModeKeep || transition.mode == Transition::ModeSkip ? u32(transition.mode) : INVALID_ID;
+      consume(transition, data);
+      if (transition.mode == Transition::ModeLeave && !mOk) {
+        return false;
+      }
+    }
+
+    // Unless replay() failed
+    return mOk;
+  }
+
+  template <class Automaton, class Handler>
+  inline bool Lexer<Automaton, Handler>::step(const Char *&data) {
+    return step(data, mAutomaton.classOf(code(*data)));
+  }
+
+  template <class Automaton, class Handler>
+  inline bool Lexer<Automaton, Handler>::step(const Char *&data, u32 classId) {
+    const Transition &transition = mAutomaton.transition(mState, classId);
+
+    // The state is set first: replay() lexes from it
+    mState = transition.state;
+    if (transition.action == Transition::ActionContinue) {
+      consume(transition, data);
+      // Unless the character is left forever
+      return transition.mode != Transition::ModeLeave || mOk;
+    }
+    return act(transition, data);
+  }
+
+  template <class Automaton, class Handler>
+  bool Lexer<Automaton, Handler>::finish() {
+    if (!mOk) {
+      return false;
+    }
+
+    // Transitions which leave the end of input are followed until it is consumed
+    for (;;) {
+      const Transition &transition = mAutomaton.transition(mState, mAutomaton.eosClass());
+      const Char *data = 0;
+
+      // A character cut by the end of input: its bytes are lexed again first
+      if (transition.action == Transition::ActionContinue && transition.mode == Transition::ModeLeavePending) {
+        mState = transition.state;
+        mOffset -= mPendingLength;
+        replay();
+        if (!mOk) {
+          return false;
+        }
+        continue;
+      }
+
+      if (transition.action != Transition::ActionContinue && !act(transition, data)) {
+        return false;
+      }
+
+      const bool stop = transition.mode != Transition::ModeLeave || transition.state == mState;
+      mState = transition.state;
+      if (stop) {
+        break;
+      }
+      if (!leave()) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  template <class Automaton, class Handler>
+  inline void Lexer<Automaton, Handler>::consume(const Transition &transition, const Char *&data) {
+    if (data == 0) {
+      return;
+    }
+
+    switch (transition.mode) {
+    case Transition::ModeKeep:
+      if (mLexeme.empty()) {
+        mBegin = mOffset;
+      }
+      keep(*data);
+      // Falls through
+    case Transition::ModeSkip:
+      ++data;
+      ++mOffset;
+      break;
+
+    case Transition::ModeLeave:
+      leave();
+      break;
+
+    default:
+      consumePending(transition, data);
+    }
+  }
+
+  template <class Automaton, class Handler>
+  void Lexer<Automaton, Handler>::consumePending(const Transition &transition, const Char *&data) {
+    switch (transition.mode) {
+    case Transition::ModePend:
+      mPending[mPendingLength++] = *data;
+      ++data;
+      ++mOffset;
+      break;
+
+    case Transition::ModeKeepPending:
+      if (mLexeme.empty()) {
+        mBegin = mOffset - mPendingLength;
+      }
+      keep(mPending, mPendingLength);
+      keep(*data);
+      mPendingLength = 0;
+      ++data;
+      ++mOffset;
+      break;
+
+    case Transition::ModeSkipPending:
+      mPendingLength = 0;
+      ++data;
+      ++mOffset;
+      break;
+
+    case Transition::ModeLeavePending:
+      // The character starts at the first pending byte
+      mOffset -= mPendingLength;
+      if (transition.action == Transition::ActionContinue) {
+        replay();
+      }
+      break;
+    }
+  }
+
+  template <class Automaton, class Handler>
+  void Lexer<Automaton, Handler>::replay() {
+    Char pending[4];
+    const u32 length = mPendingLength;
+
+    std::copy(mPending, mPending + length, pending);
+    mPendingLength = 0;
+    // A failure is seen by the next act()
+    feed(pending, length);
+  }
+
+  template <class Automaton, class Handler>
+  const typename Lexer<Automaton, Handler>::Char *Lexer<Automaton, Handler>::runAction(void *lexer, u64 *stateId, u64 classId, const Char *data) {
+    Lexer &self = *static_cast<Lexer *>(lexer);
+    self.runTo(data);
+
+    const Transition &transition = self.mAutomaton.transition(u32(*stateId), u32(classId));
+    self.mState = transition.state;
+    if (!self.act(transition, data)) {
+      return 0;
+    }
+    *stateId = self.mState;
+    self.mRunStart = data;
+    return data;
+  }
+
+  template <class Automaton, class Handler>
+  inline void Lexer<Automaton, Handler>::runTo(const Char *data) {
+    // Kept characters of a run are contiguous, past an action they start a lexeme
+    if (mRunMode == Transition::ModeKeep && data != mRunStart) {
+      if (mLexeme.empty()) {
+        mBegin = mOffset;
+      }
+      keep(mRunStart, data - mRunStart);
+    }
+    mOffset += data - mRunStart;
+  }
+
+  template <class Automaton, class Handler>
+  bool Lexer<Automaton, Handler>::leave() {
+    if (mOffset != mLeftOffset) {
+      mLeftOffset = mOffset;
+      mLeftState = mState;
+      mLeftCount = 0;
+      mLeftPower = 1;
+      return true;
+    }
+
+    if (mState == mLeftState) {
+      mHandler.failure(INVALID_ID, mOffset - mPendingLength);
+      mOk = false;
+      return false;
+    }
+    if (++mLeftCount == mLeftPower) {
+      mLeftState = mState;
+      mLeftCount = 0;
+      mLeftPower *= 2;
+    }
+    return true;
+  }
+
+  template <class Automaton, class Handler>
+  bool Lexer<Automaton, Handler>::act(const Transition &transition, const Char *&data) {
+    if (!mOk) {
+      return false;
+    }
+
+    switch (transition.action) {
+    case Transition::ActionClear:
+      consume(transition, data);
+      clearLexeme();
+      if (transition.mode == Transition::ModeLeavePending) {
+        replay();
+      }
+      return mOk;
+
+    case Transition::ActionToken: {
+      consume(transition, data);
+      if (mLexeme.empty()) {
+        mBegin = mOffset;
+      }
+      token(mAutomaton.keyword(transition.arg, mLexeme.data(), mLexeme.length()), Interning<INTERNS>());
+      clearLexeme();
+      if (transition.mode == Transition::ModeLeavePending) {
+        replay();
+      }
+      return mOk;
+    }
+
+    case Transition::ActionRecover: {
+      // The failure is where the character starts, the lexeme is dropped
+      //   before the mode applies: a kept character starts the next one
+      const u64 offset = mOffset - mPendingLength;
+      clearLexeme();
+      consume(transition, data);
+      mRecoveryCount++;
+      recover(transition.arg, offset, Recovery<HasRecovery<Handler>::value>());
+      if (transition.mode == Transition::ModeLeavePending) {
+        replay();
+      }
+      return mOk;
+    }
+
+    case Transition::ActionFailure:
+      mHandler.failure(transition.arg, mOffset - mPendingLength);
+      break;
+
+    default:
+      mHandler.failure(INVALID_ID, mOffset - mPendingLength);
+    }
+
+    mOk = false;
+    return false;
+  }
+
+  template <class Automaton, class Handler>
+  inline void Lexer<Automaton, Handler>::keep(Char c) {
+    mLexeme += c;
+    hash(c, Interning<INTERNS>());
+  }
+
+  template <class Automaton, class Handler>
+  inline void Lexer<Automaton, Handler>::keep(const Char *data, u32 length) {
+    mLexeme.append(data, length);
+    if (INTERNS) {
+      for (u32 i = 0; i < length; ++i) {
+        hash(data[i], Interning<INTERNS>());
+      }
+    }
+  }
+
+  template <class Automaton, class Handler>
+  inline void Lexer<Automaton, Handler>::clearLexeme() {
+    mLexeme.clear();
+    mHash = symbols::HASH_SEED;
+  }
+
+  template <class Automaton, class Handler>
+  inline void Lexer<Automaton, Handler>::token(u32 tokenId, Interning<true>) {
+    // Keywords resolved from an interned token are tokens of their own
+    if (mSymbols != 0 && mAutomaton.interned(tokenId)) {
+      mHandler.symbol(tokenId, mBegin, mLexeme.length(), mSymbols->intern(mLexeme.data(), mLexeme.length(), mHash));
+      return;
+    }
+    mHandler.token(tokenId, mBegin, mLexeme.data(), mLexeme.length());
+  }
+
+  template <class Automaton, class Handler>
+  inline void Lexer<Automaton, Handler>::token(u32 tokenId, Interning<false>) {
+    mHandler.token(tokenId, mBegin, mLexeme.data(), mLexeme.length());
+  }
+
+  template <class Automaton, class Handler>
+  inline void Lexer<Automaton, Handler>::recover(u32 failureId, u64 offset, Recovery<true>) {
+    mHandler.recovery(failureId, offset);
+  }
+}  // namespace lexer
+
+#endif // LEXER_HPP
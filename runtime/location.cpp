@@ -0,0 +1,64 @@
+#include "location.hpp"
+
+#include <algorithm>
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+namespace location {
+  Index::Index() :
+  mData(0),
+  mLength(0),
+  mScanned(0) {
+  }
+
+  Index::Index(const char *data, u64 length) :
+  mData(data),
+  mLength(length),
+  mScanned(0) {
+  }
+
+  void Index::append(const char *data, u32 length) {
+    scan(data, length, mScanned);
+    mScanned += length;
+    mLength = mScanned;
+  }
+
+  Position Index::locate(u64 offset) {
+    // A lazy index scans the blocks up to the one of @offset
+    while (mData && mScanned < mLength && mScanned <= offset) {
+      const u32 length = mLength - mScanned < BLOCK_SIZE ? u32(mLength - mScanned) : BLOCK_SIZE;
+      scan(mData + mScanned, length, mScanned);
+      mScanned += length;
+    }
+
+    // Breaks before @offset: the line is the next one after them
+    const u64 line = std::lower_bound(mBreaks.begin(), mBreaks.end(), offset) - mBreaks.begin();
+    const u64 lineBegin = line > 0 ? mBreaks[line - 1] + 1 : 0;
+
+    Position position;
+    position.line = line + 1;
+    position.column = offset - lineBegin + 1;
+    return position;
+  }
+
+  void Index::scan(const char *data, u32 length, u64 base) {
+    u32 i = 0;
+
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= length; i += 16) {
+      const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      for (u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)); mask != 0; mask &= mask - 1) {
+        mBreaks.push_back(base + i + __builtin_ctz(mask));
+      }
+    }
+#endif
+
+    for (; i < length; ++i) {
+      if (data[i] == '\n') {
+        mBreaks.push_back(base + i);
+      }
+    }
+  }
+}  // namespace location
@@ -0,0 +1,96 @@
+#ifndef LOCATION_HPP
+#define LOCATION_HPP
+
+#include "lexer.hpp"
+
+#include <ostream>
+#include <vector>
+#include <elib/aliases.hpp>
+
+namespace location {
+  using namespace elib::aliases;
+
+  /**
+   * Line and column (both 1-based, the column in code units)
+  **/
+  struct Position {
+    u32 line;
+    u32 column;
+  };
+
+  /**
+   * Offsets of the line breaks of an input, so the lexing loop does not
+   *   count lines: positions are looked up only when they are needed
+   * (a failure, a token a parser reports) by a binary search.
+   *
+   * The breaks are found by a SIMD scan (SSE2 if available) of a block
+   *   of input at a time:
+   *   an input in memory (see input::Buffer) is scanned lazily, only up
+   *     to the offset of the farthest query,
+   *   an input read by blocks (see input::Prefetcher) is scanned as the
+   *     blocks are handed to the lexer, via append().
+  **/
+  class Index {
+  public:
+    static const u32 BLOCK_SIZE = 64 << 10;  // Scanned at once by a lazy index
+
+  public:
+    /**
+     * Index of the input appended by blocks
+    **/
+    Index();
+
+    /**
+     * Lazy index of the input @data of @length bytes.
+     * <convention>@data must outlive the index</convention>
+    **/
+    Index(const char *data, u64 length);
+
+    /**
+     * Scans the next block @data of @length bytes of the input
+    **/
+    void append(const char *data, u32 length);
+
+    /**
+     * Returns the position of @offset.
+     *   For an index built by append(), @offset must be within the blocks
+     * appended (or right past them).
+    **/
+    Position locate(u64 offset);
+
+    /**
+     * Number of the line breaks found so far
+    **/
+    u64 breakCount() const { return mBreaks.size(); }
+
+  private:
+    /**
+     * Stores the offsets of the line breaks of @data (@length bytes at @base)
+    **/
+    void scan(const char *data, u32 length, u64 base);
+
+  private:
+    const char *mData;  // Null unless the index is lazy
+    u64 mLength;
+    u64 mScanned;       // Length of the input scanned
+    std::vector<u64> mBreaks;
+  };
+
+  /**
+   * Prints out (to @out) the failure @failureId of the runtime lexer
+   *   (a message of @failureMessages or lexer::INVALID_ID for an unexpected
+   * character) at @position.
+  **/
+  template <class Messages>
+  void report(std::ostream &out, const Messages &failureMessages, u32 failureId, const Position &position) {
+    out << "error: ";
+    if (failureId == lexer::INVALID_ID) {
+      out << "unexpected character";
+    } else {
+      out << failureMessages[failureId];
+    }
+    out << " at <" << position.line << ';' << position.column << '>' << std::endl;
+  }
+}  // namespace location
+
+#endif // LOCATION_HPP
@@ -0,0 +1,167 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "lexer.hpp"
+#include "ring.hpp"
+
+#include <pthread.h>
+#include <elib/aliases.hpp>
+
+namespace pipeline {
+  using namespace elib::aliases;
+
+  typedef lexer::Token Token;
+
+  /**
+   * Runs the lexer on its own thread, so the parser (the consumer) does
+   *   not share a core with it.
+   *
+   * Tokens are published into a ring::Ring by batches of @batchSize,
+   *   the consumer drains them by batches too via next().
+   *
+   * @Source provides the input by blocks (see input::Prefetcher and input::Buffer):
+   *     bool next(const char *&data, u32 &length);
+   *     bool ok() const;
+   * <convention>@automaton and @source must outlive the pipeline</convention>
+  **/
+  template <class Automaton, class Source>
+  class Pipeline {
+  public:
+    static const u32 DEFAULT_CAPACITY = 1 << 16;
+    static const u32 DEFAULT_BATCH_SIZE = 256;
+
+  public:
+    Pipeline(const Automaton &automaton, Source &source, u32 capacity = DEFAULT_CAPACITY, u32 batchSize = DEFAULT_BATCH_SIZE);
+    ~Pipeline();
+
+    /**
+     * Takes up to @max tokens, waiting for the lexer if none is ready.
+     * Returns the number of tokens, 0 at the end of the stream.
+    **/
+    u32 next(Token *tokens, u32 max);
+
+    /**
+     * Outcome of lexing, valid once next() has returned 0.
+     *   failureId is lexer::INVALID_ID for an unexpected character or a read error.
+    **/
+    bool ok() const { return mOk; }
+    u32 failureId() const { return mFailureId; }
+    u64 failureOffset() const { return mFailureOffset; }
+    const std::vector<lexer::Failure> &recoveries() const { return mRecoveries; }  // In input order
+
+  private:
+    Pipeline(const Pipeline &);
+    Pipeline &operator = (const Pipeline &);
+
+    /**
+     * Handler of the lexer, collects a batch before publishing it
+    **/
+    struct Producer {
+      explicit Producer(Pipeline &pipeline) : pipeline(pipeline) {}
+
+      void token(u32 tokenId, u64 offset, const char *, u32 length) {
+        Token &token = pipeline.mBatch[pipeline.mBatchLength++];
+        token.id = tokenId;
+        token.length = length;
+        token.offset = offset;
+        if (pipeline.mBatchLength == pipeline.mBatch.size()) {
+          pipeline.flush();
+        }
+      }
+
+      void failure(u32 failureId, u64 offset) {
+        pipeline.mFailureId = failureId;
+        pipeline.mFailureOffset = offset;
+      }
+
+      void recovery(u32 failureId, u64 offset) {
+        const lexer::Failure failure = {failureId, offset};
+        pipeline.mRecoveries.push_back(failure);
+      }
+
+      Pipeline &pipeline;
+    };
+
+    static void *run(void *self);
+    void lex();
+    void flush();
+
+  private:
+    const Automaton &mAutomaton;
+    Source &mSource;
+    ring::Ring<Token> mRing;
+    std::vector<Token> mBatch;
+    u32 mBatchLength;
+
+    bool mOk;
+    u32 mFailureId;
+    u64 mFailureOffset;
+    std::vector<lexer::Failure> mRecoveries;
+
+    pthread_t mThread;
+    bool mStarted;
+  };
+
+
+  template <class Automaton, class Source>
+  Pipeline<Automaton, Source>::Pipeline(const Automaton &automaton, Source &source, u32 capacity, u32 batchSize) :
+  mAutomaton(automaton),
+  mSource(source),
+  mRing(capacity),
+  mBatch(batchSize > 0 ? batchSize : 1),
+  mBatchLength(0),
+  mOk(true),
+  mFailureId(lexer::INVALID_ID),
+  mFailureOffset(0) {
+    mStarted = pthread_create(&mThread, 0, run, this) == 0;
+    if (!mStarted) {
+      mOk = false;
+      mRing.close();
+    }
+  }
+
+  template <class Automaton, class Source>
+  Pipeline<Automaton, Source>::~Pipeline() {
+    if (mStarted) {
+      // The producer may wait for free space, so the ring is drained
+      Token tokens[DEFAULT_BATCH_SIZE];
+      while (next(tokens, DEFAULT_BATCH_SIZE) > 0) {
+      }
+      pthread_join(mThread, 0);
+    }
+  }
+
+  template <class Automaton, class Source>
+  u32 Pipeline<Automaton, Source>::next(Token *tokens, u32 max) {
+    return mRing.consume(tokens, max);
+  }
+
+  template <class Automaton, class Source>
+  void *Pipeline<Automaton, Source>::run(void *self) {
+    static_cast<Pipeline *>(self)->lex();
+    return 0;
+  }
+
+  template <class Automaton, class Source>
+  void Pipeline<Automaton, Source>::lex() {
+    Producer producer(*this);
+    lexer::Lexer<Automaton, Producer> lexer(mAutomaton, producer);
+    const char *data;
+    u32 length;
+
+    while (mSource.next(data, length) && lexer.feed(data, length)) {
+    }
+    mOk = lexer.ok() && mSource.ok() && lexer.finish();
+
+    flush();
+    mRing.close();
+  }
+
+  template <class Automaton, class Source>
+  void Pipeline<Automaton, Source>::flush() {
+    mRing.publish(&mBatch[0], mBatchLength);
+    mBatchLength = 0;
+  }
+}  // namespace pipeline
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,157 @@
+#ifndef RING_HPP
+#define RING_HPP
+
+#include <sched.h>
+#include <vector>
+#include <algorithm>
+#include <elib/aliases.hpp>
+
+namespace ring {
+  using namespace elib::aliases;
+
+  /**
+   * Lock-free single-producer/single-consumer ring buffer.
+   *   Items are published and consumed by batches: every batch costs
+   * one release store on each side, whatever its size.
+   *
+   * A full ring blocks the producer (backpressure), an empty one blocks
+   *   the consumer; both wait by spinning and then yielding the processor.
+  **/
+  template <class T>
+  class Ring {
+  public:
+    /**
+     * @capacity is rounded up to a power of two
+    **/
+    explicit Ring(u32 capacity);
+
+    /**
+     * Publishes @count items, waiting for free space as long as needed.
+     * <convention>called by the producer only</convention>
+    **/
+    void publish(const T *items, u32 count);
+
+    /**
+     * Marks the end of the stream, nothing may be published afterwards.
+     * <convention>called by the producer only</convention>
+    **/
+    void close();
+
+    /**
+     * Consumes up to @max items, waiting until at least one is available.
+     * Returns the number of consumed items, 0 at the end of the stream.
+     * <convention>called by the consumer only</convention>
+    **/
+    u32 consume(T *items, u32 max);
+
+  private:
+    Ring(const Ring &);
+    Ring &operator = (const Ring &);
+
+    static void wait(u32 &spins);
+
+  private:
+    static const u32 CACHE_LINE = 64;
+    static const u32 SPINS = 256;
+
+    std::vector<T> mItems;
+    u64 mMask;
+
+    // The counters only grow, their difference is the number of published items
+    char mPadding0[CACHE_LINE];
+    u64 mHead;         // Written by the consumer
+    u64 mCachedTail;   // Consumer's view of mTail
+    char mPadding1[CACHE_LINE];
+    u64 mTail;         // Written by the producer
+    u64 mCachedHead;   // Producer's view of mHead
+    bool mClosed;
+    char mPadding2[CACHE_LINE];
+  };
+
+
+  template <class T>
+  Ring<T>::Ring(u32 capacity) :
+  mHead(0),
+  mCachedTail(0),
+  mTail(0),
+  mCachedHead(0),
+  mClosed(false) {
+    u64 size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    mItems.resize(size);
+    mMask = size - 1;
+  }
+
+  template <class T>
+  void Ring<T>::publish(const T *items, u32 count) {
+    const u64 size = mItems.size();
+    u32 spins = 0;
+
+    while (count > 0) {
+      if (mTail - mCachedHead == size) {
+        mCachedHead = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+        if (mTail - mCachedHead == size) {
+          wait(spins);
+          continue;
+        }
+      }
+
+      u64 tail = mTail;
+      const u64 end = tail + std::min<u64>(count, size - (tail - mCachedHead));
+      for (; tail < end; ++tail, ++items, --count) {
+        mItems[tail & mMask] = *items;
+      }
+      __atomic_store_n(&mTail, tail, __ATOMIC_RELEASE);
+      spins = 0;
+    }
+  }
+
+  template <class T>
+  void Ring<T>::close() {
+    __atomic_store_n(&mClosed, true, __ATOMIC_RELEASE);
+  }
+
+  template <class T>
+  u32 Ring<T>::consume(T *items, u32 max) {
+    u32 spins = 0;
+
+    while (mHead == mCachedTail) {
+      // The stream is over only if it is still empty after the close is seen
+      const bool closed = __atomic_load_n(&mClosed, __ATOMIC_ACQUIRE);
+      mCachedTail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+      if (mHead != mCachedTail) {
+        break;
+      }
+      if (closed) {
+        return 0;
+      }
+      wait(spins);
+    }
+
+    u64 head = mHead;
+    const u64 end = head + std::min<u64>(max, mCachedTail - head);
+    u32 count = 0;
+    for (; head < end; ++head, ++count) {
+      items[count] = mItems[head & mMask];
+    }
+    __atomic_store_n(&mHead, head, __ATOMIC_RELEASE);
+
+    return count;
+  }
+
+  template <class T>
+  inline void Ring<T>::wait(u32 &spins) {
+    if (spins < SPINS) {
+      spins++;
+#if defined(__i386__) || defined(__x86_64__)
+      __builtin_ia32_pause();
+#endif
+    } else {
+      sched_yield();
+    }
+  }
+}  // namespace ring
+
+#endif // RING_HPP
@@ -0,0 +1,533 @@
+#ifndef SERVICE_HPP
+#define SERVICE_HPP
+
+#include "lexer.hpp"
+#include "location.hpp"
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <string>
+#include <elib/aliases.hpp>
+
+namespace service {
+  using namespace elib::aliases;
+
+  typedef lexer::Token Token;
+
+  /**
+   * Contiguous run of tokens inside an arena
+  **/
+  struct Span {
+    const Token *tokens;
+    u32 count;
+  };
+
+  /**
+   * Token storage owned by a single thread.
+   *   Tokens are appended into large blocks which are never moved nor
+   * shared, so workers do not contend on the allocator.
+  **/
+  class Arena {
+  public:
+    static const u32 DEFAULT_BLOCK_SIZE = 1 << 16;  // In tokens
+
+  public:
+    explicit Arena(u32 blockSize = DEFAULT_BLOCK_SIZE) : mBlockSize(blockSize), mBlock(0), mUsed(0), mMarkBlock(0), mMarkUsed(0) {}
+    ~Arena() {
+      for (u32 i = 0; i < mBlocks.size(); ++i) {
+        delete[] mBlocks[i];
+      }
+    }
+
+    /**
+     * Drops all tokens, the memory is kept for reuse
+    **/
+    void clear() {
+      mBlock = mUsed = mMarkBlock = mMarkUsed = 0;
+    }
+
+    /**
+     * Starts a sequence of tokens (see end())
+    **/
+    void begin() {
+      mMarkBlock = mBlock;
+      mMarkUsed = mUsed;
+    }
+
+    void push(u32 id, u64 offset, u32 length) {
+      if (mBlock == mBlocks.size()) {
+        mBlocks.push_back(new Token[mBlockSize]);
+      }
+      Token &token = mBlocks[mBlock][mUsed];
+      token.id = id;
+      token.length = length;
+      token.offset = offset;
+      if (++mUsed == mBlockSize) {
+        mBlock++;
+        mUsed = 0;
+      }
+    }
+
+    /**
+     * Appends to @spans the tokens pushed since begin()
+    **/
+    void end(std::vector<Span> &spans) const {
+      for (u32 block = mMarkBlock, used = mMarkUsed; block <= mBlock && block < mBlocks.size(); ++block, used = 0) {
+        Span span;
+        span.tokens = mBlocks[block] + used;
+        span.count = (block == mBlock ? mUsed : mBlockSize) - used;
+        if (span.count > 0) {
+          spans.push_back(span);
+        }
+      }
+    }
+
+  private:
+    Arena(const Arena &);
+    Arena &operator = (const Arena &);
+
+  private:
+    std::vector<Token *> mBlocks;
+    u32 mBlockSize;
+    u32 mBlock;
+    u32 mUsed;
+    u32 mMarkBlock;
+    u32 mMarkUsed;
+  };
+
+  /**
+   * Tokens of a file in input order.
+   *   failureId is lexer::INVALID_ID for an unexpected character or an I/O error,
+   * failurePosition is zero for an I/O error.
+   *   Failures lexing recovered from are in input order too, a file with
+   * them is lexed successfully.
+  **/
+  struct Result {
+    Result() : ok(false), failureId(lexer::INVALID_ID), failureOffset(0), size(0), tokenCount(0) {
+      failurePosition.line = failurePosition.column = 0;
+    }
+
+    bool ok;
+    u32 failureId;
+    u64 failureOffset;
+    location::Position failurePosition;
+    u64 size;
+    u64 tokenCount;
+    std::vector<Span> spans;
+    std::vector<lexer::Failure> recoveries;
+  };
+
+  /**
+   * Lexes many files on a work-stealing thread pool.
+   *
+   * Every file is a task; files larger than @chunkSize are mapped into
+   *   memory and split into chunks which are lexed in parallel:
+   *   past synchronizing characters if the automaton has some (see
+   *     lexer::HasSync), every chunk is lexed from the state they bring
+   *     to and is right as it is,
+   *   at line ends otherwise, the chunks are lexed speculatively from
+   *     the initial state. A chunk is accepted if the previous one ends
+   *     in the initial state with no pending lexeme, otherwise the file
+   *     is lexed again as a whole.
+   * So the result never depends on the split.
+   *
+   * Tokens live in the arenas of the service until the next run or
+   *   the destruction of the service.
+  **/
+  template <class Automaton>
+  class Service {
+  public:
+    static const u32 DEFAULT_CHUNK_SIZE = 4 << 20;
+
+  public:
+    Service(const Automaton &automaton, u32 threadCount, u32 chunkSize = DEFAULT_CHUNK_SIZE);
+    ~Service();
+
+    /**
+     * Lexes @paths, @results are in the same order.
+     * Returns true if all files were lexed successfully.
+    **/
+    bool run(const std::vector<std::string> &paths, std::vector<Result> &results);
+
+  private:
+    Service(const Service &);
+    Service &operator = (const Service &);
+
+    struct Chunk {
+      Chunk() : begin(0), end(0), endState(0), lexemeLength(0), ok(false), failureId(lexer::INVALID_ID), failureOffset(0), tokenCount(0) {
+        failurePosition.line = failurePosition.column = 0;
+      }
+
+      u64 begin, end;
+      u32 endState;
+      u32 lexemeLength;
+      bool ok;
+      u32 failureId;
+      u64 failureOffset;
+      location::Position failurePosition;
+      std::vector<Span> spans;
+      u64 tokenCount;
+      std::vector<lexer::Failure> recoveries;
+    };
+
+    struct File {
+      const char *data;  // Mapped, null for files lexed by a single task
+      u64 size;
+      std::vector<Chunk> chunks;
+    };
+
+    struct Task {
+      u32 file;
+      u32 chunk;
+    };
+
+    struct Worker {
+      Service *service;
+      u32 id;
+      pthread_t thread;
+      pthread_mutex_t mutex;
+      std::deque<Task> tasks;
+      Arena arena;
+      std::vector<char> buffer;
+    };
+
+    /**
+     * Handler of the lexer, appends tokens to an arena
+    **/
+    struct Collector {
+      Collector(Arena &arena, u64 base) : arena(arena), base(base), count(0), failureId(lexer::INVALID_ID), failureOffset(0) {}
+
+      void token(u32 tokenId, u64 offset, const char *, u32 length) {
+        arena.push(tokenId, base + offset, length);
+        count++;
+      }
+
+      void failure(u32 id, u64 offset) {
+        failureId = id;
+        failureOffset = base + offset;
+      }
+
+      void recovery(u32 id, u64 offset) {
+        const lexer::Failure failure = {id, base + offset};
+        recoveries.push_back(failure);
+      }
+
+      Arena &arena;
+      u64 base;
+      u64 count;
+      u32 failureId;
+      u64 failureOffset;
+      std::vector<lexer::Failure> recoveries;
+    };
+
+    template <bool Synchronizes>
+    struct Sync {};
+
+    u32 syncState(Sync<true>) const { return mAutomaton.syncState(); }
+    u32 syncState(Sync<false>) const { return lexer::INVALID_ID; }
+    const char *sync(const char *data, const char *end, Sync<true>) const { return mAutomaton.sync(data, end); }
+    const char *sync(const char *, const char *end, Sync<false>) const { return end; }
+
+    static void *work(void *worker);
+    bool take(Worker &worker, Task &task);
+    void execute(Worker &worker, const Task &task);
+    void lex(Arena &arena, const char *data, u64 begin, u64 end, bool last, Chunk &chunk);
+    void release();
+
+  private:
+    const Automaton &mAutomaton;
+    u32 mSyncState;  // INVALID_ID unless chunks are split past synchronizing characters
+    u32 mChunkSize;
+    const std::vector<std::string> *mPaths;
+    std::vector<File> mFiles;
+    std::vector<Worker *> mWorkers;
+    Arena mArena;  // Tokens of the files lexed again after a failed speculation
+  };
+
+
+  template <class Automaton>
+  Service<Automaton>::Service(const Automaton &automaton, u32 threadCount, u32 chunkSize) :
+  mAutomaton(automaton),
+  mSyncState(syncState(Sync<lexer::HasSync<Automaton>::value>())),
+  mChunkSize(chunkSize > 0 ? chunkSize : DEFAULT_CHUNK_SIZE),
+  mPaths(0) {
+    mWorkers.resize(threadCount > 0 ? threadCount : 1);
+    for (u32 i = 0; i < mWorkers.size(); ++i) {
+      Worker *worker = new Worker();
+      worker->service = this;
+      worker->id = i;
+      pthread_mutex_init(&worker->mutex, 0);
+      mWorkers[i] = worker;
+    }
+  }
+
+  template <class Automaton>
+  Service<Automaton>::~Service() {
+    release();
+    for (u32 i = 0; i < mWorkers.size(); ++i) {
+      pthread_mutex_destroy(&mWorkers[i]->mutex);
+      delete mWorkers[i];
+    }
+  }
+
+  template <class Automaton>
+  bool Service<Automaton>::run(const std::vector<std::string> &paths, std::vector<Result> &results) {
+    release();
+    mArena.clear();
+    mPaths = &paths;
+    mFiles.assign(paths.size(), File());
+
+    // Plan: a task per small file, a task per chunk of a large one
+    std::vector<Task> tasks;
+    for (u32 fileId = 0; fileId < paths.size(); ++fileId) {
+      File &file = mFiles[fileId];
+      Task task;
+      task.file = fileId;
+      task.chunk = 0;
+
+      file.data = 0;
+      file.size = 0;
+
+      struct stat info;
+      if (stat(paths[fileId].c_str(), &info) == 0 && u64(info.st_size) > mChunkSize) {
+        const int fd = open(paths[fileId].c_str(), O_RDONLY);
+        void *data = fd < 0 ? MAP_FAILED : mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (fd >= 0) {
+          close(fd);
+        }
+        if (data != MAP_FAILED) {
+          file.data = static_cast<const char *>(data);
+          file.size = info.st_size;
+          madvise(data, info.st_size, MADV_SEQUENTIAL);
+        }
+      }
+
+      if (file.data == 0) {
+        file.chunks.resize(1);
+        tasks.push_back(task);
+        continue;
+      }
+
+      for (u64 begin = 0; begin < file.size; ) {
+        u64 end = begin + mChunkSize;
+        if (end >= file.size) {
+          end = file.size;
+        } else if (mSyncState != lexer::INVALID_ID) {
+          end = sync(file.data + end, file.data + file.size, Sync<lexer::HasSync<Automaton>::value>()) - file.data;
+        } else {
+          // Line ends are the most likely places to be back in the initial state
+          const void *newline = memchr(file.data + end, '\n', file.size - end);
+          end = newline ? static_cast<const char *>(newline) - file.data + 1 : file.size;
+        }
+
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = end;
+        file.chunks.push_back(chunk);
+        tasks.push_back(task);
+        task.chunk++;
+        begin = end;
+      }
+    }
+
+    // Tasks are dealt round-robin, idle workers steal the rest
+    for (u32 i = 0; i < mWorkers.size(); ++i) {
+      mWorkers[i]->arena.clear();
+    }
+    for (u32 i = 0; i < tasks.size(); ++i) {
+      mWorkers[i % mWorkers.size()]->tasks.push_back(tasks[i]);
+    }
+
+    std::vector<bool> started(mWorkers.size(), false);
+    for (u32 i = 1; i < mWorkers.size(); ++i) {
+      started[i] = pthread_create(&mWorkers[i]->thread, 0, work, mWorkers[i]) == 0;
+    }
+    work(mWorkers[0]);
+    for (u32 i = 1; i < mWorkers.size(); ++i) {
+      if (started[i]) {
+        pthread_join(mWorkers[i]->thread, 0);
+      } else {
+        // Tasks of a worker which has not started are left for the others
+        work(mWorkers[i]);
+      }
+    }
+
+    // Stitch the chunks in input order
+    bool success = true;
+    results.assign(paths.size(), Result());
+    for (u32 fileId = 0; fileId < mFiles.size(); ++fileId) {
+      File &file = mFiles[fileId];
+      Result &result = results[fileId];
+
+      // Chunks split past synchronizing characters are right as they are
+      bool speculated = true;
+      for (u32 i = 0; i + 1 < file.chunks.size() && mSyncState == lexer::INVALID_ID; ++i) {
+        const Chunk &chunk = file.chunks[i];
+        if (!chunk.ok || chunk.endState != mAutomaton.initialState() || chunk.lexemeLength != 0) {
+          speculated = false;
+          break;
+        }
+      }
+
+      if (!speculated) {
+        file.chunks.resize(1);
+        mArena.begin();
+        lex(mArena, file.data, 0, file.size, true, file.chunks[0]);
+      }
+
+      result.size = file.data ? file.size : file.chunks[0].end;
+      result.ok = true;
+      for (u32 i = 0; i < file.chunks.size() && result.ok; ++i) {
+        const Chunk &chunk = file.chunks[i];
+        result.spans.insert(result.spans.end(), chunk.spans.begin(), chunk.spans.end());
+        result.recoveries.insert(result.recoveries.end(), chunk.recoveries.begin(), chunk.recoveries.end());
+        result.tokenCount += chunk.tokenCount;
+        result.ok = chunk.ok;
+        result.failureId = chunk.failureId;
+        result.failureOffset = chunk.failureOffset;
+        result.failurePosition = chunk.failurePosition;
+      }
+      success = success && result.ok;
+    }
+
+    return success;
+  }
+
+  template <class Automaton>
+  void *Service<Automaton>::work(void *self) {
+    Worker &worker = *static_cast<Worker *>(self);
+    Task task;
+
+    while (worker.service->take(worker, task)) {
+      worker.service->execute(worker, task);
+    }
+    return 0;
+  }
+
+  template <class Automaton>
+  bool Service<Automaton>::take(Worker &worker, Task &task) {
+    // Own tasks are taken from the back, stolen ones from the front
+    pthread_mutex_lock(&worker.mutex);
+    if (!worker.tasks.empty()) {
+      task = worker.tasks.back();
+      worker.tasks.pop_back();
+      pthread_mutex_unlock(&worker.mutex);
+      return true;
+    }
+    pthread_mutex_unlock(&worker.mutex);
+
+    for (u32 i = 1; i < mWorkers.size(); ++i) {
+      Worker &victim = *mWorkers[(worker.id + i) % mWorkers.size()];
+      pthread_mutex_lock(&victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        pthread_mutex_unlock(&victim.mutex);
+        return true;
+      }
+      pthread_mutex_unlock(&victim.mutex);
+    }
+
+    // No task is ever added during a run, so there is nothing left to do
+    return false;
+  }
+
+  template <class Automaton>
+  void Service<Automaton>::execute(Worker &worker, const Task &task) {
+    File &file = mFiles[task.file];
+    Chunk &chunk = file.chunks[task.chunk];
+
+    worker.arena.begin();
+    if (file.data) {
+      lex(worker.arena, file.data, chunk.begin, chunk.end, task.chunk + 1 == file.chunks.size(), chunk);
+      return;
+    }
+
+    // A small file is read as a whole into the buffer of the worker
+    chunk.begin = chunk.end = 0;
+    const int fd = open((*mPaths)[task.file].c_str(), O_RDONLY);
+    bool success = fd >= 0;
+    while (success) {
+      if (chunk.end == worker.buffer.size()) {
+        worker.buffer.resize(worker.buffer.empty() ? 1 << 16 : 2 * worker.buffer.size());
+      }
+      const ssize_t count = read(fd, &worker.buffer[chunk.end], worker.buffer.size() - chunk.end);
+      if (count > 0) {
+        chunk.end += count;
+      } else if (count < 0 && errno == EINTR) {
+        continue;
+      } else {
+        success = count == 0;
+        break;
+      }
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+
+    if (success) {
+      lex(worker.arena, &worker.buffer[0], 0, chunk.end, true, chunk);
+    } else {
+      chunk.ok = false;
+      chunk.failureId = lexer::INVALID_ID;
+      chunk.failureOffset = chunk.end;
+      chunk.failurePosition.line = chunk.failurePosition.column = 0;
+      chunk.tokenCount = 0;
+    }
+  }
+
+  template <class Automaton>
+  void Service<Automaton>::lex(Arena &arena, const char *data, u64 begin, u64 end, bool last, Chunk &chunk) {
+    const bool synchronized = mSyncState != lexer::INVALID_ID;
+    Collector collector(arena, begin);
+    lexer::Lexer<Automaton, Collector> lexer(mAutomaton, collector);
+    if (begin > 0 && synchronized) {
+      lexer.reset(mSyncState);
+    }
+
+    const u64 BLOCK = 1 << 30;
+    for (u64 i = begin; i < end && lexer.ok(); i += BLOCK) {
+      lexer.feed(data + i, u32(end - i < BLOCK ? end - i : BLOCK));
+    }
+    if (last) {
+      lexer.finish();
+    }
+
+    chunk.spans.clear();
+    arena.end(chunk.spans);
+    chunk.tokenCount = collector.count;
+    chunk.endState = lexer.state();
+    chunk.lexemeLength = lexer.lexemeLength();
+    chunk.ok = lexer.ok();
+    chunk.failureId = collector.failureId;
+    chunk.failureOffset = collector.failureOffset;
+    chunk.recoveries.swap(collector.recoveries);
+
+    // Failures of the other speculative chunks make the file lexed again as
+    //   a whole, so lines are counted only for a failure which is reported
+    chunk.failurePosition.line = chunk.failurePosition.column = 0;
+    if (!chunk.ok && (last || synchronized)) {
+      location::Index index(data, end);
+      chunk.failurePosition = index.locate(chunk.failureOffset);
+    }
+  }
+
+  template <class Automaton>
+  void Service<Automaton>::release() {
+    for (u32 i = 0; i < mFiles.size(); ++i) {
+      if (mFiles[i].data) {
+        munmap(const_cast<char *>(mFiles[i].data), mFiles[i].size);
+      }
+    }
+    mFiles.clear();
+  }
+}  // namespace service
+
+#endif // SERVICE_HPP
@@ -0,0 +1,276 @@
+#include "stream.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+
+namespace stream {
+  static const char HEADER_MAGIC[] = "WAYSTOK1";
+  static const char TRAILER_MAGIC[] = "WAYSIDX1";
+  static const u32 MAGIC_SIZE = 8;
+  static const u32 HEADER_SIZE = 16;
+  static const u32 BLOCK_HEADER_SIZE = 16;
+  static const u32 INDEX_ENTRY_SIZE = 24;
+  static const u32 TRAILER_SIZE = 48;
+
+
+  Writer::Writer(std::ostream &out, u32 blockSize) :
+  mOut(out),
+  mBlockSize(blockSize > 0 ? blockSize : DEFAULT_BLOCK_SIZE),
+  mBlockTokens(0),
+  mBase(0),
+  mEnd(0),
+  mTokens(0),
+  mPosition(0),
+  mOk(true),
+  mFailureId(lexer::INVALID_ID),
+  mFailureOffset(0),
+  mClosed(false) {
+    mOut.write(HEADER_MAGIC, MAGIC_SIZE);
+    mPosition += MAGIC_SIZE;
+    put(VERSION, 4);
+    put(mBlockSize, 4);
+  }
+
+  void Writer::token(u32 tokenId, u64 offset, const char *, u32 length) {
+    if (mBlockTokens == 0) {
+      mBase = mEnd = offset;
+    }
+
+    varint(mPayload, tokenId);
+    varint(mPayload, offset - mEnd);
+    varint(mPayload, length);
+    mEnd = offset + length;
+
+    mTokens++;
+    if (++mBlockTokens == mBlockSize) {
+      flush();
+    }
+  }
+
+  void Writer::failure(u32 failureId, u64 offset) {
+    mOk = false;
+    mFailureId = failureId;
+    mFailureOffset = offset;
+  }
+
+  bool Writer::close() {
+    if (mClosed) {
+      return mOut.good();
+    }
+    mClosed = true;
+
+    flush();
+
+    const u64 indexPosition = mPosition;
+    for (u32 i = 0; i < mIndex.size(); ++i) {
+      put(mIndex[i], 8);
+    }
+
+    put(indexPosition, 8);
+    put(mIndex.size() / 3, 8);
+    put(mTokens, 8);
+    put(mFailureId, 4);
+    put(mOk ? 1 : 0, 4);
+    put(mFailureOffset, 8);
+    mOut.write(TRAILER_MAGIC, MAGIC_SIZE);
+    mPosition += MAGIC_SIZE;
+
+    mOut.flush();
+    return mOut.good();
+  }
+
+  void Writer::flush() {
+    if (mBlockTokens == 0) {
+      return;
+    }
+
+    mIndex.push_back(mPosition);
+    mIndex.push_back(mTokens - mBlockTokens);
+    mIndex.push_back(mBase);
+
+    put(mPayload.size(), 4);
+    put(mBlockTokens, 4);
+    put(mBase, 8);
+    while (mPayload.size() % 8 != 0) {
+      mPayload.push_back(0);
+    }
+    mOut.write(reinterpret_cast<const char *>(&mPayload[0]), mPayload.size());
+    mPosition += mPayload.size();
+
+    mPayload.clear();
+    mBlockTokens = 0;
+  }
+
+  void Writer::put(u64 value, u32 size) {
+    char bytes[8];
+    for (u32 i = 0; i < size; ++i) {
+      bytes[i] = char(value >> (8 * i));
+    }
+    mOut.write(bytes, size);
+    mPosition += size;
+  }
+
+  void Writer::varint(std::vector<u8> &out, u64 value) {
+    while (value >= 0x80) {
+      out.push_back(u8(value) | 0x80);
+      value >>= 7;
+    }
+    out.push_back(u8(value));
+  }
+
+
+  Reader::Reader() :
+  mData(0),
+  mSize(0),
+  mIndex(0),
+  mBlockCount(0),
+  mTokenCount(0),
+  mOk(false),
+  mFailureId(lexer::INVALID_ID),
+  mFailureOffset(0),
+  mBlock(0),
+  mNext(0),
+  mLeft(0),
+  mEnd(0) {
+  }
+
+  Reader::~Reader() {
+    close();
+  }
+
+  bool Reader::open(const std::string &path) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && u64(info.st_size) >= HEADER_SIZE + TRAILER_SIZE) {
+      data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+
+    mData = static_cast<const u8 *>(data);
+    mSize = info.st_size;
+
+    const u8 *trailer = mData + mSize - TRAILER_SIZE;
+    const u64 indexPosition = get(trailer, 8);
+    mBlockCount = get(trailer + 8, 8);
+    mTokenCount = get(trailer + 16, 8);
+    mFailureId = get(trailer + 24, 4);
+    mOk = get(trailer + 28, 4) != 0;
+    mFailureOffset = get(trailer + 32, 8);
+
+    if (std::memcmp(mData, HEADER_MAGIC, MAGIC_SIZE) != 0 || get(mData + MAGIC_SIZE, 4) != VERSION
+        || std::memcmp(trailer + 40, TRAILER_MAGIC, MAGIC_SIZE) != 0
+        || indexPosition + mBlockCount * INDEX_ENTRY_SIZE != mSize - TRAILER_SIZE) {
+      close();
+      return false;
+    }
+
+    mIndex = mData + indexPosition;
+    return seek(0) || mTokenCount == 0;
+  }
+
+  void Reader::close() {
+    if (mData) {
+      munmap(const_cast<u8 *>(mData), mSize);
+    }
+    mData = mIndex = mNext = 0;
+    mSize = mBlockCount = mTokenCount = 0;
+    mLeft = 0;
+  }
+
+  bool Reader::seek(u64 index) {
+    if (index >= mTokenCount) {
+      return false;
+    }
+
+    // The last block starting at or before the token
+    u64 low = 0, high = mBlockCount;
+    while (high - low > 1) {
+      const u64 middle = (low + high) / 2;
+      if (get(mIndex + middle * INDEX_ENTRY_SIZE + 8, 8) <= index) {
+        low = middle;
+      } else {
+        high = middle;
+      }
+    }
+
+    if (!enter(low)) {
+      return false;
+    }
+
+    Token token;
+    for (u64 skip = index - get(mIndex + low * INDEX_ENTRY_SIZE + 8, 8); skip > 0; --skip) {
+      read(&token, 1);
+    }
+    return true;
+  }
+
+  u32 Reader::read(Token *tokens, u32 max) {
+    u32 count = 0;
+
+    while (count < max) {
+      if (mLeft == 0 && !enter(mBlock + 1)) {
+        break;
+      }
+
+      const u8 *p = mNext;
+      u32 n = mLeft < max - count ? mLeft : max - count;
+      mLeft -= n;
+      for (; n > 0; --n, ++count) {
+        u64 values[3];
+        for (u32 i = 0; i < 3; ++i) {
+          u64 value = 0;
+          u32 shift = 0;
+          while (*p & 0x80) {
+            value |= u64(*p++ & 0x7f) << shift;
+            shift += 7;
+          }
+          values[i] = value | (u64(*p++) << shift);
+        }
+
+        Token &token = tokens[count];
+        token.id = values[0];
+        token.offset = mEnd + values[1];
+        token.length = values[2];
+        mEnd = token.offset + token.length;
+      }
+      mNext = p;
+    }
+
+    return count;
+  }
+
+  u64 Reader::get(const u8 *data, u32 size) {
+    u64 value = 0;
+    for (u32 i = 0; i < size; ++i) {
+      value |= u64(data[i]) << (8 * i);
+    }
+    return value;
+  }
+
+  bool Reader::enter(u64 block) {
+    if (block >= mBlockCount) {
+      mLeft = 0;
+      return false;
+    }
+
+    const u8 *header = mData + get(mIndex + block * INDEX_ENTRY_SIZE, 8);
+    mBlock = block;
+    mLeft = get(header + 4, 4);
+    mEnd = get(header + 8, 8);
+    mNext = header + BLOCK_HEADER_SIZE;
+    return true;
+  }
+}  // namespace stream
@@ -0,0 +1,136 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include "lexer.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <elib/aliases.hpp>
+
+/**
+ * Binary token stream: stores the output of the lexer for replaying.
+ *
+ * All integers are little-endian, every structure is 8-byte aligned,
+ *   so a stream may be read right from a mapped file:
+ *
+ *   header:  magic "WAYSTOK1", u32 version, u32 block size (in tokens)
+ *   blocks:  u32 payload length, u32 token count, u64 base offset,
+ *            payload: for each token varint(id), varint(delta), varint(length)
+ *            where delta is the distance from the end of the previous token
+ *            of the block (from the base offset for the first one),
+ *            zero padding up to 8 bytes
+ *   index:   for each block u64 position, u64 first token number, u64 base offset
+ *   trailer: u64 index position, u64 block count, u64 token count,
+ *            u32 failure id, u32 ok, u64 failure offset, magic "WAYSIDX1"
+ *
+ * Blocks are independent, so the index allows to seek to any token.
+**/
+namespace stream {
+  using namespace elib::aliases;
+
+  typedef lexer::Token Token;
+
+  const u32 VERSION = 1;
+
+  /**
+   * Handler of the runtime lexer which writes the tokens into @out
+  **/
+  class Writer {
+  public:
+    static const u32 DEFAULT_BLOCK_SIZE = 4096;  // In tokens
+
+  public:
+    explicit Writer(std::ostream &out, u32 blockSize = DEFAULT_BLOCK_SIZE);
+
+    void token(u32 tokenId, u64 offset, const char *lexeme, u32 length);
+    void failure(u32 failureId, u64 offset);
+
+    /**
+     * Writes the last block, the index and the trailer.
+     * Returns true if the stream was written successfully.
+    **/
+    bool close();
+
+  private:
+    void flush();
+    void put(u64 value, u32 size);
+    static void varint(std::vector<u8> &out, u64 value);
+
+  private:
+    std::ostream &mOut;
+    u32 mBlockSize;
+    std::vector<u8> mPayload;
+    std::vector<u64> mIndex;
+    u32 mBlockTokens;
+    u64 mBase;
+    u64 mEnd;  // End of the previous token of the block
+    u64 mTokens;
+    u64 mPosition;
+    bool mOk;
+    u32 mFailureId;
+    u64 mFailureOffset;
+    bool mClosed;
+  };
+
+  /**
+   * Replays a stream from a mapped file
+  **/
+  class Reader {
+  public:
+    Reader();
+    ~Reader();
+
+    /**
+     * Maps the file @path and checks its structure.
+     * Returns true if succeeds or false if fails.
+    **/
+    bool open(const std::string &path);
+    void close();
+
+    u64 tokenCount() const { return mTokenCount; }
+
+    /**
+     * Outcome of lexing the stream was written from
+    **/
+    bool ok() const { return mOk; }
+    u32 failureId() const { return mFailureId; }
+    u64 failureOffset() const { return mFailureOffset; }
+
+    /**
+     * Moves to the token number @index (the next one read).
+     * Returns false if there is no such token.
+    **/
+    bool seek(u64 index);
+
+    /**
+     * Reads up to @max next tokens.
+     * Returns the number of tokens read, 0 at the end of the stream.
+    **/
+    u32 read(Token *tokens, u32 max);
+
+  private:
+    Reader(const Reader &);
+    Reader &operator = (const Reader &);
+
+    static u64 get(const u8 *data, u32 size);
+    bool enter(u64 block);
+
+  private:
+    const u8 *mData;
+    u64 mSize;
+    const u8 *mIndex;
+    u64 mBlockCount;
+    u64 mTokenCount;
+    bool mOk;
+    u32 mFailureId;
+    u64 mFailureOffset;
+
+    u64 mBlock;       // Current block
+    const u8 *mNext;  // Next token of the current block
+    u32 mLeft;        // Tokens left in the current block
+    u64 mEnd;
+  };
+}  // namespace stream
+
+#endif // STREAM_HPP
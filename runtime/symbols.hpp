@@ -0,0 +1,139 @@
+#ifndef SYMBOLS_HPP
+#define SYMBOLS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <elib/aliases.hpp>
+
+namespace symbols {
+  using namespace elib::aliases;
+
+  const u32 INVALID_ID = u32(-1);
+
+  typedef unsigned int Hash;  // 32 bits, whatever u32 is
+
+  /**
+   * FNV-1a over code units (characters are unsigned whatever the type):
+   *   the lexer folds every kept code unit into the hash of the lexeme as
+   * it goes (see lexer::HasSymbols), so a symbol is looked up with no
+   * second pass over its characters.
+  **/
+  const Hash HASH_SEED = 2166136261u;
+
+  template <class Char>
+  inline Hash hash(Hash value, Char c) { return (value ^ Hash(c)) * 16777619u; }
+  inline Hash hash(Hash value, char c) { return (value ^ u8(c)) * 16777619u; }
+
+  /**
+   * Symbol table: interns lexemes into dense ids, in order of the first
+   *   occurrence. Characters of all the symbols are stored contiguously in
+   * one arena, the slots are open addressing over the hashes.
+   *     symbols::Table<char> table;
+   *     lexer.intern(&table);
+   *     ...
+   *     // In Handler::symbol()
+   *     std::string name(table.data(symbolId), table.length(symbolId));
+  **/
+  template <class Char>
+  class Table {
+  public:
+    Table();
+
+    /**
+     * Returns the id of the lexeme @data (of @length characters), a new one
+     *   if it is not interned yet; @hashValue is its hash (see hash()).
+    **/
+    u32 intern(const Char *data, u32 length, Hash hashValue);
+    u32 intern(const Char *data, u32 length);
+
+    /**
+     * Drops all symbols, the memory is kept for reuse
+    **/
+    void clear();
+
+    u32 count() const { return mOffsets.size() - 1; }
+    const Char *data(u32 id) const { return mArena.empty() ? 0 : &mArena[0] + mOffsets[id]; }
+    u32 length(u32 id) const { return mOffsets[id + 1] - mOffsets[id]; }
+
+  private:
+    void grow();
+
+  private:
+    std::vector<Char> mArena;
+    std::vector<u32> mOffsets;  // Symbol i occupies [mOffsets[i], mOffsets[i+1]) of the arena
+    std::vector<Hash> mHashes;
+    std::vector<u32> mSlots;    // INVALID_ID for a free slot
+  };
+
+
+  template <class Char>
+  Table<Char>::Table() :
+  mOffsets(1, 0),
+  mSlots(64, INVALID_ID) {
+  }
+
+  template <class Char>
+  u32 Table<Char>::intern(const Char *data, u32 length) {
+    Hash hashValue = HASH_SEED;
+    for (u32 i = 0; i < length; ++i) {
+      hashValue = hash(hashValue, data[i]);
+    }
+    return intern(data, length, hashValue);
+  }
+
+  template <class Char>
+  u32 Table<Char>::intern(const Char *data, u32 length, Hash hashValue) {
+    const u32 mask = mSlots.size() - 1;
+
+    for (u32 slot = hashValue & mask;; slot = (slot + 1) & mask) {
+      const u32 id = mSlots[slot];
+      if (id == INVALID_ID) {
+        break;
+      }
+      if (mHashes[id] == hashValue && this->length(id) == length && std::equal(data, data + length, mArena.begin() + mOffsets[id])) {
+        return id;
+      }
+    }
+
+    const u32 id = count();
+    mArena.insert(mArena.end(), data, data + length);
+    mOffsets.push_back(mArena.size());
+    mHashes.push_back(hashValue);
+
+    // The table is kept at most half full
+    if (2 * count() > mSlots.size()) {
+      grow();
+    } else {
+      u32 slot = hashValue & mask;
+      while (mSlots[slot] != INVALID_ID) {
+        slot = (slot + 1) & mask;
+      }
+      mSlots[slot] = id;
+    }
+    return id;
+  }
+
+  template <class Char>
+  void Table<Char>::clear() {
+    mArena.clear();
+    mOffsets.resize(1);
+    mHashes.clear();
+    std::fill(mSlots.begin(), mSlots.end(), INVALID_ID);
+  }
+
+  template <class Char>
+  void Table<Char>::grow() {
+    mSlots.assign(2 * mSlots.size(), INVALID_ID);
+    const u32 mask = mSlots.size() - 1;
+
+    for (u32 id = 0; id < count(); ++id) {
+      u32 slot = mHashes[id] & mask;
+      while (mSlots[slot] != INVALID_ID) {
+        slot = (slot + 1) & mask;
+      }
+      mSlots[slot] = id;
+    }
+  }
+}  // namespace symbols
+
+#endif // SYMBOLS_HPP
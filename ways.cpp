@@ -2,7 +2,10 @@
 using namespace elib::aliases;
 
 #include "ways.hpp"
-#include "notation.hpp"
+#include "output.hpp"
+#include "runtime/lexer.hpp"
+#include "runtime/location.hpp"
+#include "bootstrap/tables.hpp"
 
 #include <vector>
 #include <string>
@@ -11,6 +14,11 @@ using namespace elib::aliases;
 #include <stack>
 #include <cassert>
 #include <sstream>
+#include <ctime>
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
 
 
 #ifdef DEBUG
@@ -19,427 +27,2034 @@ using namespace elib::aliases;
   #define DEBUG_PRINTLN(...)
 #endif
 
+const char *Ways::VERSION = "0.50";
+
 const u32 Ways::charsetSize = 256;
 
 const u32 Ways::INVALID_ID = u32(-1);
 
-const char *Ways::KEYWORD_INITIAL = "initial";
-const char *Ways::KEYWORD_STATE = "state";
-const char *Ways::KEYWORD_ON = "on";
-const char *Ways::KEYWORD_GO = "go";
-const char *Ways::KEYWORD_KEEP = "keep";
-const char *Ways::KEYWORD_SKIP = "skip";
-const char *Ways::KEYWORD_CLEAR = "clear";
-const char *Ways::KEYWORD_TOKEN = "token";
-const char *Ways::KEYWORD_FAILURE = "failure";
-const char *Ways::KEYWORD_TRANSITION = "transition";
-const char *Ways::KEYWORD_END = "end";
-
-const char Ways::DELIM_COLON = ':';
-const char Ways::DELIM_SEMICOLON = ';';
-const char Ways::DELIM_LPAREN = '(';
-const char Ways::DELIM_RPAREN = ')';
-
-
-bool Ways::parse(std::istream &in, std::map<std::string, u32> &stateMap, std::vector<RuleGroup> &definition, u32 &initialStateId) {
-    notation::source src(in);
+
+u32 Ways::alphabetSize(Options::Alphabet alphabet) {
+  switch (alphabet) {
+  case Options::Alphabet16:
+    return 0x10000;
+  case Options::Alphabet32:
+  case Options::AlphabetUtf8:
+    // Code points of Unicode, larger code units are unallocated characters
+    return 0x110000;
+  default:
+    return charsetSize;
+  }
+}
+
+
+u32 Ways::unitsOf(const Definition &definition, const std::vector<u32> &bounds, const Rule &rule, std::vector<u32> &units) {
+  units.clear();
+
+  if (bounds.empty()) {
+    u8 chars[charsetSize];
+    const u32 count = rule.onChars.list(chars);
+    units.assign(chars, chars + count);
+    return count;
+  }
+
+  for (u32 i = rule.firstRange; i < rule.firstRange + rule.rangeCount; ++i) {
+    const Range &range = definition.ranges[i];
+    const u32 first = std::lower_bound(bounds.begin(), bounds.end(), range.first) - bounds.begin();
+    const u32 last = std::lower_bound(bounds.begin() + first, bounds.end(), range.last + 1) - bounds.begin();
+    for (u32 unit = first; unit < last; ++unit) {
+      units.push_back(unit);
+    }
+  }
+
+  // Ranges of a set may overlap
+  if (rule.rangeCount > 1) {
+    std::sort(units.begin(), units.end());
+    units.erase(std::unique(units.begin(), units.end()), units.end());
+  }
+  return units.size();
+}
+
+
+u32 Ways::CharSet::list(u8 *chars) const {
+  // Upper half first (signed char order): classes have always been allocated in it
+  static const u32 order[4] = {2, 3, 0, 1};
+  u32 count = 0;
+
+  for (u32 i = 0; i < 4; ++i) {
+    for (u64 word = bits[order[i]]; word != 0; word &= word - 1) {
+      chars[count++] = u8(order[i] * 64 + __builtin_ctzll(word));
+    }
+  }
+  return count;
+}
+
+
+namespace {
+  typedef bootstrap::Tokens SpecTokens;
+
+  const u32 CODE_POINT_LIMIT = 0x110000;
+
+  /**
+   * Appends the UTF-8 encoding of @c to @out
+  **/
+  void encode(u32 c, std::string &out) {
+    if (c < 0x80) {
+      out += char(c);
+    } else if (c < 0x800) {
+      out += char(0xc0 | (c >> 6));
+      out += char(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      out += char(0xe0 | (c >> 12));
+      out += char(0x80 | ((c >> 6) & 0x3f));
+      out += char(0x80 | (c & 0x3f));
+    } else {
+      out += char(0xf0 | (c >> 18));
+      out += char(0x80 | ((c >> 12) & 0x3f));
+      out += char(0x80 | ((c >> 6) & 0x3f));
+      out += char(0x80 | (c & 0x3f));
+    }
+  }
+
+  /**
+   * Decodes UTF-8 text @data (of @length bytes) into code points @chars.
+   *   Surrogates are accepted: they are characters of 16-bit alphabets.
+   * Returns true if succeeds or false if the text is malformed.
+  **/
+  bool decode(const char *data, u32 length, std::vector<u32> &chars) {
+    chars.clear();
+    // Smallest code point of a sequence by its number of trailing bytes (shorter ones are overlong)
+    static const u32 minimum[4] = {0, 0x80, 0x800, 0x10000};
+
+    for (u32 i = 0; i < length;) {
+      const u8 lead = data[i++];
+      u32 c, tail;
+      if (lead < 0x80) {
+        c = lead, tail = 0;
+      } else if (lead >= 0xc0 && lead < 0xe0) {
+        c = lead & 0x1f, tail = 1;
+      } else if (lead >= 0xe0 && lead < 0xf0) {
+        c = lead & 0x0f, tail = 2;
+      } else if (lead >= 0xf0 && lead < 0xf8) {
+        c = lead & 0x07, tail = 3;
+      } else {
+        return false;
+      }
+      if (length - i < tail) {
+        return false;
+      }
+      for (u32 j = 0; j < tail; ++j) {
+        const u8 next = data[i++];
+        if ((next & 0xc0) != 0x80) {
+          return false;
+        }
+        c = (c << 6) | (next & 0x3f);
+      }
+      if (c < minimum[tail] || c >= CODE_POINT_LIMIT) {
+        return false;
+      }
+      chars.push_back(c);
+    }
+    return true;
+  }
+
+  /**
+   * Tokens of a specification, lexed by the bootstrap lexer (see bootstrap/ways.fa).
+   *   The whole text is lexed before parsing; then the parser moves forward
+   * one token at a time, with no backtracking.
+  **/
+  class Spec {
+  public:
+    static const u32 END = lexer::INVALID_ID;  // Id of the token past the last one
+
+  public:
+    /**
+     * Escapes `\u{X}` of strings are bytes if @wide is false,
+     *   otherwise they are UTF-8 encoded code points.
+    **/
+    Spec(const std::string &text, bool wide) :
+    mText(text),
+    mWide(wide),
+    mCurrent(0),
+    mFailureId(lexer::INVALID_ID),
+    mFailureMessage(0),
+    mFailureOffset(0),
+    mLocations(text.data(), text.size()) {}
+
+    /**
+     * Lexes the text and checks code point escapes of the strings.
+     * Returns true if succeeds or false if fails.
+    **/
+    bool lex() {
+      bootstrap::Automaton automaton;
+      lexer::Lexer<bootstrap::Automaton, Spec> lexer(automaton, *this);
+      if (!lexer.feed(mText.data(), mText.length()) || !lexer.finish()) {
+        return false;
+      }
+
+      const u32 limit = mWide ? CODE_POINT_LIMIT : 0x100;
+      for (u32 i = 0; i < mTokens.size(); ++i) {
+        const lexer::Token &token = mTokens[i];
+        if (token.id != SpecTokens::string) {
+          continue;
+        }
+        const char *raw = mText.data() + token.offset;
+        for (u32 j = 0; j < token.length; ++j) {
+          if (raw[j] == '\\' && raw[++j] == 'u' && codePoint(raw + j + 2) >= limit) {
+            mFailureMessage = mWide ? "code point out of the range of Unicode" : "code point out of the 8-bit alphabet";
+            mFailureOffset = token.offset + j - 1;
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Message of the lexing failure, null for an unexpected character
+    **/
+    const char *failureMessage() const {
+      return mFailureMessage ? mFailureMessage : mFailureId != lexer::INVALID_ID ? bootstrap::failureMessages[mFailureId] : 0;
+    }
+    u64 failureOffset() const { return mFailureOffset; }
+
+    // Handler of the lexer
+    void token(u32 tokenId, u64 offset, const char *, u32 length) {
+      const lexer::Token token = {tokenId, length, offset};
+      mTokens.push_back(token);
+    }
+
+    void failure(u32 failureId, u64 offset) {
+      mFailureId = failureId;
+      mFailureOffset = offset;
+    }
+
+    u32 id() const { return mCurrent < mTokens.size() ? mTokens[mCurrent].id : END; }
+    u64 offset() const { return mCurrent < mTokens.size() ? mTokens[mCurrent].offset : mText.length(); }
+
+    void next() { mCurrent++; }
+
+    /**
+     * Moves to the next token if the current one is @tokenId.
+     * Returns true if it was or false otherwise.
+    **/
+    bool accept(u32 tokenId) {
+      if (id() != tokenId) {
+        return false;
+      }
+      next();
+      return true;
+    }
+
+    /**
+     * Checks if the current token is a name: an identifier or a keyword
+     *   (keywords are reserved nowhere, `state token:` is a valid declaration).
+    **/
+    bool isName() const {
+      const u32 tokenId = id();
+      return tokenId == SpecTokens::identifier || (tokenId >= SpecTokens::kw_keywords && tokenId <= SpecTokens::kw_intern);
+    }
+
+    /**
+     * Takes a name (see isName()), @data points into the text.
+     * Returns true if the current token is a name or false otherwise.
+    **/
+    bool name(const char *&data, u32 &length) {
+      if (!isName()) {
+        return false;
+      }
+      data = mText.data() + offset();
+      length = mTokens[mCurrent].length;
+      next();
+      return true;
+    }
+
+    /**
+     * Takes a string resolving its escape sequences,
+     *   @data is valid until the next string is taken.
+     * Returns true if the current token is a string or false otherwise.
+    **/
+    bool string(const char *&data, u32 &length) {
+      if (id() != SpecTokens::string) {
+        return false;
+      }
+
+      const char *raw = mText.data() + offset();
+      const u32 rawLength = mTokens[mCurrent].length;
+      mValue.clear();
+      for (u32 i = 0; i < rawLength; ++i) {
+        char c = raw[i];
+        if (c == '\\') {
+          switch (c = raw[++i]) {
+          case 'n': c = '\n'; break;
+          case 'r': c = '\r'; break;
+          case 't': c = '\t'; break;
+          case 'f': c = '\f'; break;
+          case 'v': c = '\v'; break;
+          case 'u': {
+            // Checked by lex()
+            const u32 code = codePoint(raw + i + 2);
+            while (raw[i] != '}') {
+              ++i;
+            }
+            if (mWide) {
+              encode(code, mValue);
+            } else {
+              mValue += char(code);
+            }
+            continue;
+          }
+          }
+        }
+        mValue += c;
+      }
+
+      data = mValue.data();
+      length = mValue.length();
+      next();
+      return true;
+    }
+
+    /**
+     * Line and column (both 1-based) of the current token
+    **/
+    void position(u32 &line, u32 &column) {
+      position(offset(), line, column);
+    }
+
+    /**
+     * Line and column (both 1-based) of @offset
+    **/
+    void position(u64 offset, u32 &line, u32 &column) {
+      const location::Position position = mLocations.locate(offset);
+      line = position.line;
+      column = position.column;
+    }
+
+  private:
+    /**
+     * Value of the hexadecimal digits at @digits (closed by `}`),
+     *   saturated to CODE_POINT_LIMIT
+    **/
+    static u32 codePoint(const char *digits) {
+      u32 code = 0;
+      for (; *digits != '}'; ++digits) {
+        const char c = *digits;
+        const u32 digit = c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+        code = std::min<u32>(code * 16 + digit, CODE_POINT_LIMIT);
+      }
+      return code;
+    }
+
+  private:
+    const std::string &mText;
+    bool mWide;
+    std::vector<lexer::Token> mTokens;
+    u32 mCurrent;
+    std::string mValue;  // Last string taken
+    u32 mFailureId;
+    const char *mFailureMessage;
+    u64 mFailureOffset;
+    location::Index mLocations;
+  };
+}
+
+
+/**
+ * Lowers the states of a UTF-8 definition one at a time (see Ways::lowerUtf8()).
+ *   Multibyte characters of a state are a trie of byte states (nodes): cells of
+ * a node are the 64 continuation bytes, each one is invalid, the last byte of
+ * characters of a rule or a prefix of the characters of a child node.
+**/
+class Ways::Utf8Lowering {
+public:
+  explicit Utf8Lowering(Definition &definition) : mDefinition(definition) {}
+
+  void lower();
+
+private:
+  enum {
+    CellInvalid,
+    CellLast,
+    CellPrefix
+  };
+
+  static const u32 NONE = u32(-1);   // No rule: an unexpected character
+  static const u32 MIXED = u32(-2);  // Several rules
+
+  /**
+   * Rule of all the code points [first, last] of the current state,
+   *   NONE or MIXED
+  **/
+  u32 ownerOf(u32 first, u32 last) const;
+
+  /**
+   * Node reading @remaining bytes of characters starting at @first,
+   *   of @length bytes. Returns NONE if all of them are invalid.
+  **/
+  u32 node(u32 first, u32 remaining, u32 length);
+
+  /**
+   * Node reading @remaining bytes of characters of the rule @owner
+  **/
+  u32 uniform(u32 owner, u32 remaining);
+
+  u32 intern(const std::vector<u32> &cells);
+  u32 nameOf(u32 node);
+
+  /**
+   * Name of the state lexing the bytes of a malformed character of the
+   *   state @stateId as stray ones
+  **/
+  u32 strayNameOf(u32 stateId);
+
+private:
+  Definition &mDefinition;
+  u32 mStateId;  // Current state
+  std::vector<u32> mDefaults;  // Default rule of every state, NONE if none
+
+  // Code points [mBounds[i], mBounds[i+1]) of the current state are of the rule mOwners[i]
+  std::vector<u32> mBounds;
+  std::vector<u32> mOwners;
+  std::map<std::pair<u32, u32>, u32> mUniform;
+
+  std::map<std::vector<u32>, u32> mNodeIds;
+  std::vector<std::vector<u32> > mNodes;  // Kind and value of every cell
+  std::vector<u32> mNodeStates;           // State of the rules of every node
+};
+
+void Ways::Utf8Lowering::lower() {
+  Definition &definition = mDefinition;
+  std::vector<State> &states = definition.states;
+  const std::vector<Rule> &rules = definition.rules;
+  const std::vector<Range> &ranges = definition.ranges;
+  const u32 stateCount = states.size();
+  std::vector<Rule> lowered;
+
+  mDefaults.assign(stateCount, u32(NONE));
+  for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+    State &state = states[stateId];
+    mStateId = stateId;
+    const u32 firstRule = state.firstRule;
+    const u32 lastRule = state.firstRule + state.ruleCount;
+
+    // Multibyte code points by rule, the last one of a code point wins
+    u32 defaultRule = NONE;
+    mBounds.clear();
+    mBounds.push_back(0x80);
+    mBounds.push_back(CODE_POINT_LIMIT);
+    for (u32 ruleId = firstRule; ruleId < lastRule; ++ruleId) {
+      const Rule &rule = rules[ruleId];
+      if (!rule.optionOn) {
+        defaultRule = ruleId;
+      }
+      for (u32 i = rule.firstRange; i < rule.firstRange + rule.rangeCount; ++i) {
+        if (ranges[i].last >= 0x80) {
+          mBounds.push_back(std::max<u32>(ranges[i].first, 0x80));
+          mBounds.push_back(ranges[i].last + 1);
+        }
+      }
+    }
+    std::sort(mBounds.begin(), mBounds.end());
+    mBounds.erase(std::unique(mBounds.begin(), mBounds.end()), mBounds.end());
+    mDefaults[stateId] = defaultRule;
+
+    mOwners.assign(mBounds.size() - 1, defaultRule);
+    for (u32 ruleId = firstRule; ruleId < lastRule; ++ruleId) {
+      const Rule &rule = rules[ruleId];
+      for (u32 i = rule.firstRange; i < rule.firstRange + rule.rangeCount; ++i) {
+        if (ranges[i].last < 0x80) {
+          continue;
+        }
+        u32 interval = std::lower_bound(mBounds.begin(), mBounds.end(), std::max<u32>(ranges[i].first, 0x80)) - mBounds.begin();
+        for (; mBounds[interval] <= ranges[i].last; ++interval) {
+          mOwners[interval] = ruleId;
+        }
+      }
+    }
+    mUniform.clear();
+
+    // Leading bytes: 2-byte characters, then 3-byte and 4-byte ones
+    u32 leads[charsetSize];
+    for (u32 c = 0; c < charsetSize; ++c) {
+      if (c >= 0xc2 && c < 0xe0) {
+        leads[c] = node((c & 0x1f) << 6, 1, 2);
+      } else if (c >= 0xe0 && c < 0xf0) {
+        leads[c] = node((c & 0x0f) << 12, 2, 3);
+      } else if (c >= 0xf0 && c < 0xf5) {
+        leads[c] = node((c & 0x07) << 18, 3, 4);
+      } else {
+        leads[c] = NONE;
+      }
+    }
+
+    // Rules keep their ASCII characters, the leading bytes go to the nodes
+    state.firstRule = lowered.size();
+    for (u32 ruleId = firstRule; ruleId < lastRule; ++ruleId) {
+      Rule rule = rules[ruleId];
+      for (u32 i = rule.firstRange; i < rule.firstRange + rule.rangeCount; ++i) {
+        for (u32 c = ranges[i].first; c <= ranges[i].last && c < 0x80; ++c) {
+          rule.onChars.insert(c);
+        }
+      }
+      rule.firstRange = rule.rangeCount = 0;
+      lowered.push_back(rule);
+    }
+
+    std::vector<bool> done(charsetSize, false);
+    for (u32 c = 0; c < charsetSize; ++c) {
+      if (leads[c] == NONE || done[c]) {
+        continue;
+      }
+
+      Rule rule;
+      rule.state = stateId;
+      rule.optionOn = true;
+      rule.optionGo = true;
+      rule.goState = nameOf(leads[c]);
+      rule.sequence = Rule::SequencePrefix;
+      for (u32 other = c; other < charsetSize; ++other) {
+        if (leads[other] == leads[c]) {
+          rule.onChars.insert(other);
+          done[other] = true;
+        }
+      }
+      lowered.push_back(rule);
+    }
+    state.ruleCount = lowered.size() - state.firstRule;
+  }
+
+  // Every node is a state with a rule per distinct cell
+  for (u32 nodeId = 0; nodeId < mNodes.size(); ++nodeId) {
+    const std::vector<u32> &cells = mNodes[nodeId];
+    State state;
+    state.name = nameOf(nodeId);
+    state.firstRule = lowered.size();
+
+    std::vector<bool> done(64, false);
+    for (u32 c = 0; c < 64; ++c) {
+      const u32 kind = cells[2*c];
+      const u32 value = cells[2*c + 1];
+      if (kind == CellInvalid || done[c]) {
+        continue;
+      }
+
+      Rule rule;
+      if (kind == CellLast) {
+        const Rule &owner = rules[value];
+        rule = owner;
+        rule.onEos = false;
+        rule.onChars.clear();
+        rule.firstRange = rule.rangeCount = 0;
+        rule.sequence = Rule::SequenceLast;
+        // Transitions without `go` stay in the state the character started in
+        if (!rule.optionGo && !rule.optionFailure) {
+          rule.optionGo = true;
+          rule.goState = states[owner.state].name;
+        }
+      } else {
+        rule.optionGo = true;
+        rule.goState = nameOf(value);
+        rule.sequence = Rule::SequencePrefix;
+      }
+      rule.state = states.size();
+      rule.optionOn = true;
+
+      for (u32 other = c; other < 64; ++other) {
+        if (cells[2*other] == kind && cells[2*other + 1] == value) {
+          rule.onChars.insert(0x80 + other);
+          done[other] = true;
+        }
+      }
+      lowered.push_back(rule);
+    }
+
+    // A byte which may not continue the character makes it malformed: its bytes
+    //   are lexed again as stray ones, by the default rule of the state it started in
+    if (mDefaults[mNodeStates[nodeId]] != NONE) {
+      Rule rule;
+      rule.state = states.size();
+      rule.optionGo = true;
+      rule.goState = strayNameOf(mNodeStates[nodeId]);
+      rule.sequence = Rule::SequenceLast;
+      lowered.push_back(rule);
+    }
+
+    state.ruleCount = lowered.size() - state.firstRule;
+    states.push_back(state);
+  }
+
+  // States of the stray bytes: the leading byte takes the default rule, the
+  //   bytes after it are lexed from where the rule goes as any stray byte
+  std::vector<bool> stray(stateCount, false);
+  for (u32 nodeId = 0; nodeId < mNodes.size(); ++nodeId) {
+    stray[mNodeStates[nodeId]] = mDefaults[mNodeStates[nodeId]] != NONE;
+  }
+  for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+    if (!stray[stateId]) {
+      continue;
+    }
+
+    State state;
+    state.name = strayNameOf(stateId);
+    state.firstRule = lowered.size();
+
+    Rule rule = rules[mDefaults[stateId]];
+    rule.state = states.size();
+    rule.optionOn = true;
+    rule.onEos = false;
+    rule.onChars.clear();
+    rule.firstRange = rule.rangeCount = 0;
+    for (u32 c = 0xc2; c < 0xf5; ++c) {
+      rule.onChars.insert(c);
+    }
+    // Transitions without `go` stay in the state the character started in
+    if (!rule.optionGo && !rule.optionFailure) {
+      rule.optionGo = true;
+      rule.goState = states[stateId].name;
+    }
+    lowered.push_back(rule);
+
+    state.ruleCount = 1;
+    states.push_back(state);
+  }
+
+  DEBUG_PRINTLN("UTF-8: " << mNodes.size() << " byte state(s) for " << stateCount << " state(s)");
+
+  definition.rules.swap(lowered);
+  definition.ranges.clear();
+  definition.alphabetSize = charsetSize;
+  definition.stateOfName.resize(definition.names.count(), INVALID_ID);
+  for (u32 stateId = stateCount; stateId < states.size(); ++stateId) {
+    definition.stateOfName[states[stateId].name] = stateId;
+  }
+}
+
+u32 Ways::Utf8Lowering::ownerOf(u32 first, u32 last) const {
+  const u32 interval = std::upper_bound(mBounds.begin(), mBounds.end(), first) - mBounds.begin() - 1;
+  return mBounds[interval + 1] > last ? mOwners[interval] : MIXED;
+}
+
+u32 Ways::Utf8Lowering::node(u32 first, u32 remaining, u32 length) {
+  // Smallest code point of a character by its length (shorter encodings are overlong)
+  static const u32 minimum[5] = {0, 0, 0x80, 0x800, 0x10000};
+  const u32 span = u32(1) << (6 * (remaining - 1));
+  std::vector<u32> cells(2 * 64, 0);
+  bool valid = false;
+
+  for (u32 c = 0; c < 64; ++c) {
+    const u32 low = first + c * span;
+    const u32 high = low + span - 1;
+
+    // Surrogates are not characters
+    if (low < minimum[length] || high >= CODE_POINT_LIMIT || (low >= 0xd800 && high <= 0xdfff)) {
+      continue;
+    }
+
+    const u32 owner = ownerOf(low, high);
+    u32 child = NONE;
+    if (owner == MIXED) {
+      child = node(low, remaining - 1, length);
+    } else if (owner != NONE) {
+      if (remaining == 1) {
+        cells[2*c] = CellLast;
+        cells[2*c + 1] = owner;
+        valid = true;
+        continue;
+      }
+      child = uniform(owner, remaining - 1);
+    }
+
+    if (child != NONE) {
+      cells[2*c] = CellPrefix;
+      cells[2*c + 1] = child;
+      valid = true;
+    }
+  }
+
+  return valid ? intern(cells) : NONE;
+}
+
+u32 Ways::Utf8Lowering::uniform(u32 owner, u32 remaining) {
+  const std::pair<u32, u32> key(owner, remaining);
+  std::map<std::pair<u32, u32>, u32>::iterator entry = mUniform.find(key);
+  if (entry != mUniform.end()) {
+    return entry->second;
+  }
+
+  std::vector<u32> cells(2 * 64);
+  const u32 child = remaining == 1 ? owner : uniform(owner, remaining - 1);
+  for (u32 c = 0; c < 64; ++c) {
+    cells[2*c] = remaining == 1 ? CellLast : CellPrefix;
+    cells[2*c + 1] = child;
+  }
+  return mUniform[key] = intern(cells);
+}
+
+u32 Ways::Utf8Lowering::intern(const std::vector<u32> &cells) {
+  const std::pair<std::map<std::vector<u32>, u32>::iterator, bool> entry = mNodeIds.insert(std::make_pair(cells, u32(mNodes.size())));
+  if (entry.second) {
+    mNodes.push_back(cells);
+    mNodeStates.push_back(mStateId);
+  }
+  return entry.first->second;
+}
+
+u32 Ways::Utf8Lowering::nameOf(u32 node) {
+  // Not an identifier, so no state of the specification has it
+  std::ostringstream name;
+  name << "utf8#" << node;
+  const std::string text = name.str();
+  return mDefinition.names.intern(text.data(), text.length());
+}
+
+u32 Ways::Utf8Lowering::strayNameOf(u32 stateId) {
+  // Not an identifier either, nor a name of a node
+  const std::string text = "utf8#" + mDefinition.names.name(mDefinition.states[stateId].name);
+  return mDefinition.names.intern(text.data(), text.length());
+}
+
+void Ways::lowerUtf8(Definition &definition) {
+  Utf8Lowering(definition).lower();
+}
+
+
+bool Ways::parse(std::istream &in, Definition &definition) {
+    std::ostringstream text;
+    text << in.rdbuf();
+
+    const std::string source = text.str();
+    const bool wide = definition.alphabetSize != charsetSize;
+    Spec spec(source, wide);
+    Interner &names = definition.names;
+    std::vector<u32> &stateOfName = definition.stateOfName;
+    std::vector<Rule> &rules = definition.rules;
+    std::vector<Range> &ranges = definition.ranges;
+    std::vector<u32> chars;
+    const char *data;
+    u32 length;
     u32 line, column;
 
-    initialStateId = INVALID_ID;
+    if (!spec.lex()) {
+      spec.position(spec.failureOffset(), line, column);
+      if (spec.failureMessage() == 0) {
+        diagnostics() << "error: unexpected character `";
+        escape(diagnostics(), source[spec.failureOffset()]);
+        diagnostics() << "` at <" << line << ';' << column << '>' << std::endl;
+      } else {
+        diagnostics() << "error: " << spec.failureMessage() << " at <" << line << ';' << column << '>' << std::endl;
+      }
+      return false;
+    }
+
+    for (;;) {
+      spec.position(line, column);
+
+      if (spec.accept(SpecTokens::kw_keywords)) {
+        u32 baseName;
 
-    while (src >> notation::ws() >> notation::pos(line, column) >> notation::keyword(KEYWORD_STATE) >> true) {
-      std::string stateName;
+        DEBUG_PRINTLN("keyword `keywords` at <" << line << ';' << column << '>');
+
+        // Lexemes of wide alphabets are not byte strings
+        if (wide && !definition.utf8) {
+          diagnostics() << "error: keywords are supported by the 8-bit alphabet only at <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
+
+        spec.position(line, column);
+        if (!spec.name(data, length)) {
+          diagnostics() << "error: missing expected token name at <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
+        baseName = names.intern(data, length);
+
+        spec.position(line, column);
+        if (!spec.accept(SpecTokens::colon)) {
+          diagnostics() << "error: missing expected colon at <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
+        DEBUG_PRINTLN(std::endl << std::endl << "keywords of token `" << names.name(baseName) << "` declaration opened at <" << line << ';' << column << '>');
+
+        for (spec.position(line, column); spec.accept(SpecTokens::kw_keyword); spec.position(line, column)) {
+          Keyword keyword;
+          keyword.baseName = baseName;
+          keyword.line = line;
+          keyword.column = column;
+
+          spec.position(line, column);
+          if (!spec.accept(SpecTokens::left_paren)) {
+            diagnostics() << "error: missing expected left parenthesis at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+
+          spec.position(line, column);
+          if (!spec.string(data, length)) {
+            diagnostics() << "error: missing expected keyword lexeme at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+
+          if (length == 0) {
+            diagnostics() << "error: empty keyword specified at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+          keyword.lexeme = names.intern(data, length);
+
+          spec.position(line, column);
+          if (!spec.accept(SpecTokens::right_paren)) {
+            diagnostics() << "error: missing expected right parenthesis at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+
+          spec.position(line, column);
+          if (!spec.accept(SpecTokens::kw_token)) {
+            diagnostics() << "error: missing expected option `token` at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+
+          spec.position(line, column);
+          if (!spec.accept(SpecTokens::left_paren)) {
+            diagnostics() << "error: missing expected left parenthesis at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+
+          spec.position(line, column);
+          if (spec.name(data, length)) {
+            keyword.tokenName = names.intern(data, length);
+            DEBUG_PRINTLN("keyword(\"" << names.name(keyword.lexeme) << "\") token(\"" << names.name(keyword.tokenName) << "\")");
+          } else {
+            diagnostics() << "error: missing expected token name at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+
+          spec.position(line, column);
+          if (!spec.accept(SpecTokens::right_paren)) {
+            diagnostics() << "error: missing expected right parenthesis at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+
+          spec.position(line, column);
+          if (!spec.accept(SpecTokens::semicolon)) {
+            diagnostics() << "error: missing expected semicolon at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+
+          definition.keywords.push_back(keyword);
+        }
+
+        if (!spec.accept(SpecTokens::semicolon)) {
+          diagnostics() << "error: missing expected semicolon before <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
+        DEBUG_PRINTLN("keywords of token `" << names.name(baseName) << "` declaration closed at <" << line << ';' << column << '>');
+        continue;
+      }
+
+      if (spec.accept(SpecTokens::kw_intern)) {
+        Intern intern;
+        intern.line = line;
+        intern.column = column;
+
+        DEBUG_PRINTLN("keyword `intern` at <" << line << ';' << column << '>');
+
+        spec.position(line, column);
+        if (!spec.name(data, length)) {
+          diagnostics() << "error: missing expected token name at <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
+        intern.tokenName = names.intern(data, length);
+
+        spec.position(line, column);
+        if (!spec.accept(SpecTokens::semicolon)) {
+          diagnostics() << "error: missing expected semicolon at <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
+        DEBUG_PRINTLN("token `" << names.name(intern.tokenName) << "` interned");
+
+        definition.interns.push_back(intern);
+        continue;
+      }
+
+      if (!spec.accept(SpecTokens::kw_state)) {
+        break;
+      }
+
+      u32 stateName;
       u32 stateId;
 
       DEBUG_PRINTLN("keyword `state` at <" << line << ';' << column << '>');
 
-      if (src >> notation::ws() >> notation::pos(line, column) >> notation::id(stateName) >> false) {
-        std::cerr << "error: missing expected symbolic name of state at <" << line << ';' << column << '>' << std::endl;
+      spec.position(line, column);
+      if (!spec.name(data, length)) {
+        diagnostics() << "error: missing expected symbolic name of state at <" << line << ';' << column << '>' << std::endl;
         return false;
       }
-      DEBUG_PRINTLN("state name `" << stateName << "` at <" << line << ';' << column << '>');
+      stateName = names.intern(data, length);
+      DEBUG_PRINTLN("state name `" << names.name(stateName) << "` at <" << line << ';' << column << '>');
+
+      const bool isInitial = spec.accept(SpecTokens::kw_initial);
+
+      // Characters which bring lexing back to this state: `sync("...")`
+      spec.position(line, column);
+      const u32 syncLine = line;
+      const u32 syncColumn = column;
+      const bool isSync = spec.accept(SpecTokens::kw_sync);
+      std::vector<u32> syncChars;
+      if (isSync) {
+        spec.position(line, column);
+        if (!spec.accept(SpecTokens::left_paren)) {
+          diagnostics() << "error: missing expected left parenthesis at <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
 
-#ifdef DEBUG
-      if (stateMap.count(stateName) > 0) {
-        DEBUG_PRINTLN("redefinition of state `" << stateName << "` at <" << line << ';' << column << '>');
-      }
-#endif
+        for (spec.position(line, column); spec.string(data, length); spec.position(line, column)) {
+          if (wide && !decode(data, length, chars)) {
+            diagnostics() << "error: malformed UTF-8 in character set at <" << line << ';' << column << '>' << std::endl;
+            return false;
+          }
+          if (!wide) {
+            chars.assign(reinterpret_cast<const u8 *>(data), reinterpret_cast<const u8 *>(data) + length);
+          }
+          // A single code unit in every alphabet, so the parts of a split input are whole characters
+          for (u32 i = 0; i < chars.size(); ++i) {
+            if (chars[i] >= 0x80) {
+              diagnostics() << "error: synchronizing characters must be ASCII at <" << line << ';' << column << '>' << std::endl;
+              return false;
+            }
+            syncChars.push_back(chars[i]);
+          }
+        }
 
-      bool isInitial = false;
-      if (src >> notation::ws() >> notation::keyword(KEYWORD_INITIAL) >> true) {
-        isInitial = true;
+        if (syncChars.empty()) {
+          diagnostics() << "error: missing expected synchronizing characters at <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
+        if (!spec.accept(SpecTokens::right_paren)) {
+          diagnostics() << "error: missing expected right parenthesis at <" << line << ';' << column << '>' << std::endl;
+          return false;
+        }
+        DEBUG_PRINTLN("sync(" << syncChars.size() << " character(s))");
       }
 
-      if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_COLON) >> false) {
-        std::cerr << "error: missing expected colon since <" << line << ';' << column << '>' << std::endl;
+      spec.position(line, column);
+      if (!spec.accept(SpecTokens::colon)) {
+        diagnostics() << "error: missing expected colon at <" << line << ';' << column << '>' << std::endl;
         return false;
       }
 
-      src >> notation::pos(line, column); // For debug only
-      DEBUG_PRINTLN(std::endl << std::endl << "state `" << stateName << "` declaration opened at <" << line << ';' << column << '>');
+      DEBUG_PRINTLN(std::endl << std::endl << "state `" << names.name(stateName) << "` declaration opened at <" << line << ';' << column << '>');
 
-      // Find RuleGroup corresponding to state_name or create a new one
-      if (stateMap.count(stateName)) {
-        stateId = stateMap[stateName];
+      // Find the state named stateName or declare a new one
+      if (stateName >= stateOfName.size()) {
+        stateOfName.resize(names.count(), INVALID_ID);
+      }
+      if (stateOfName[stateName] != INVALID_ID) {
+        stateId = stateOfName[stateName];
+        DEBUG_PRINTLN("redefinition of state `" << names.name(stateName) << "` at <" << line << ';' << column << '>');
       } else {
-        RuleGroup group;
-        group.stateName = stateName;
-        definition.push_back(group);
-        stateId = definition.size() - 1;
-        stateMap[stateName] = stateId;
+        State state;
+        state.name = stateName;
+        state.firstRule = state.ruleCount = 0;
+        definition.states.push_back(state);
+        stateId = definition.states.size() - 1;
+        stateOfName[stateName] = stateId;
       }
 
-      RuleGroup &group = definition[stateId];
-      std::vector<Rule> &rules = group.rules;
-
       if (isInitial) {
         DEBUG_PRINTLN("this one is initial");
-        if (initialStateId != INVALID_ID && stateId != initialStateId) {
-          std::cerr << "error: state `" << definition[initialStateId].stateName << "` was earlier declared as initial" << std::endl;
+        if (definition.initialStateId != INVALID_ID && stateId != definition.initialStateId) {
+          diagnostics() << "error: state `" << names.name(definition.states[definition.initialStateId].name) << "` was earlier declared as initial" << std::endl;
           return false;
         }
-        initialStateId = stateId;
+        definition.initialStateId = stateId;
       }
 #ifdef DEBUG
-      else if (stateId == initialStateId) {
+      else if (stateId == definition.initialStateId) {
         DEBUG_PRINTLN("this one is initial");
       }
 #endif
 
-      while (src >> notation::ws() >> notation::keyword(KEYWORD_TRANSITION) >> notation::pos(line, column) >> true) {
+      if (isSync) {
+        if (definition.syncStateId != INVALID_ID && stateId != definition.syncStateId) {
+          diagnostics() << "error: state `" << names.name(definition.states[definition.syncStateId].name) << "` was earlier declared as synchronizing at <" << syncLine << ';' << syncColumn << '>' << std::endl;
+          return false;
+        }
+        definition.syncStateId = stateId;
+        definition.syncChars.insert(definition.syncChars.end(), syncChars.begin(), syncChars.end());
+        definition.syncLine = syncLine;
+        definition.syncColumn = syncColumn;
+      }
+
+      for (spec.position(line, column); spec.accept(SpecTokens::kw_transition); spec.position(line, column)) {
         rules.push_back(Rule());
 
         Rule &rule = rules.back();
+        rule.state = stateId;
         rule.line = line;
         rule.column = column;
+        definition.states[stateId].ruleCount++;
 
-        DEBUG_PRINTLN(std::endl << "transition (from state `" << stateName << "`) declaration opened at <" << line << ';' << column << '>');
+        DEBUG_PRINTLN(std::endl << "transition (from state `" << names.name(stateName) << "`) declaration opened at <" << line << ';' << column << '>');
 
-        std::string optionName;
+        for (spec.position(line, column); spec.isName(); spec.position(line, column)) {
+          const u32 optionId = spec.id();
+          spec.name(data, length);
 
-        while (src >> notation::ws() >> notation::pos(line, column) >> notation::id(optionName) >> true) {
-          DEBUG_PRINTLN("option name `" << optionName << "` at <" << line << ';' << column << '>');
+          DEBUG_PRINTLN("option name `" << std::string(data, length) << "` at <" << line << ';' << column << '>');
 
-          if (optionName == KEYWORD_ON) {
+          switch (optionId) {
+          case SpecTokens::kw_on:
             if (rule.optionOn == true) {
-              std::cerr << "error: redefinition of option `on` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
+              diagnostics() << "error: redefinition of option `on` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
               return false;
             }
 
             rule.optionOn = true;
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_LPAREN) >> false) {
-              std::cerr << "error: missing expected left parenthesis since <" << line << ';' << column << '>' << std::endl;
+            spec.position(line, column);
+            if (!spec.accept(SpecTokens::left_paren)) {
+              diagnostics() << "error: missing expected left parenthesis at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
 
-            std::string onChars;
-            src >> notation::pos(line, column) >> notation::ws();
-            if (src >> notation::keyword(KEYWORD_END) >> true) {
-              DEBUG_PRINTLN("on(end)");
-              rule.onEos = true;
-            } else if (src >> notation::str(onChars) >> true) {
-              rule.onChars.insert(onChars.begin(), onChars.end());
-#ifdef DEBUG
-              std::stringstream stringStream;
-              for (u32 i = 0; i < onChars.length(); ++i) {
-                escape(stringStream, onChars[i]);
+            // Items of the set: `end`, strings and ranges `"a".."z"` of single characters
+            rule.firstRange = definition.ranges.size();
+            for (spec.position(line, column);; spec.position(line, column)) {
+              if (spec.accept(SpecTokens::kw_end)) {
+                DEBUG_PRINTLN("on(end)");
+                rule.onEos = true;
+                continue;
               }
-              DEBUG_PRINTLN("on(\"" << stringStream.str() << "\")");
-#endif
+              if (!spec.string(data, length)) {
+                break;
+              }
+
+              if (wide && !decode(data, length, chars)) {
+                diagnostics() << "error: malformed UTF-8 in character set at <" << line << ';' << column << '>' << std::endl;
+                return false;
+              }
+              if (!wide) {
+                chars.assign(reinterpret_cast<const u8 *>(data), reinterpret_cast<const u8 *>(data) + length);
+              }
+
+              if (spec.id() == SpecTokens::dots) {
+                std::vector<u32> lasts;
+                spec.next();
+                spec.position(line, column);
+                if (!spec.string(data, length)) {
+                  diagnostics() << "error: missing expected upper bound of range at <" << line << ';' << column << '>' << std::endl;
+                  return false;
+                }
+                if (wide && !decode(data, length, lasts)) {
+                  diagnostics() << "error: malformed UTF-8 in character set at <" << line << ';' << column << '>' << std::endl;
+                  return false;
+                }
+                if (!wide) {
+                  lasts.assign(reinterpret_cast<const u8 *>(data), reinterpret_cast<const u8 *>(data) + length);
+                }
+                if (chars.size() != 1 || lasts.size() != 1) {
+                  diagnostics() << "error: bounds of range must be single characters at <" << line << ';' << column << '>' << std::endl;
+                  return false;
+                }
+                if (chars[0] > lasts[0]) {
+                  diagnostics() << "error: inverted range at <" << line << ';' << column << '>' << std::endl;
+                  return false;
+                }
+                DEBUG_PRINTLN("on(" << chars[0] << ".." << lasts[0] << ")");
+                const Range range = {chars[0], lasts[0]};
+                ranges.push_back(range);
+              } else {
+                DEBUG_PRINTLN("on(" << chars.size() << " character(s))");
+                for (u32 i = 0; i < chars.size(); ++i) {
+                  const Range range = {chars[i], chars[i]};
+                  ranges.push_back(range);
+                }
+              }
+            }
+
+            for (u32 i = rule.firstRange; i < ranges.size(); ++i) {
+              if (ranges[i].last >= definition.alphabetSize) {
+                diagnostics() << "error: character out of the alphabet at <" << rule.line << ';' << rule.column << '>' << std::endl;
+                return false;
+              }
+            }
+
+            // 8-bit sets are bitsets
+            if (!wide) {
+              for (u32 i = rule.firstRange; i < ranges.size(); ++i) {
+                for (u32 c = ranges[i].first; c <= ranges[i].last; ++c) {
+                  rule.onChars.insert(c);
+                }
+              }
+              ranges.resize(rule.firstRange);
             }
+            rule.rangeCount = ranges.size() - rule.firstRange;
 
-            if (rule.onEos == false && rule.onChars.empty()) {
-              std::cerr << "error: empty character set specified since <" << line << ';' << column << '>' << std::endl;
+            if (rule.onEos == false && rule.onChars.empty() && rule.rangeCount == 0) {
+              diagnostics() << "error: empty character set specified at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_RPAREN) >> false) {
-              std::cerr << "error: missing expected right parenthesis since <" << line << ';' << column << '>' << std::endl;
+            spec.position(line, column);
+            if (!spec.accept(SpecTokens::right_paren)) {
+              diagnostics() << "error: missing expected right parenthesis at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
-          } else if (optionName == KEYWORD_GO) {
+            break;
+
+          case SpecTokens::kw_go:
             if (rule.optionGo == true) {
-              std::cerr << "error: redefinition of option `go` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
+              diagnostics() << "error: redefinition of option `go` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
               return false;
             }
 
             rule.optionGo = true;
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_LPAREN) >> false) {
-              std::cerr << "error: missing expected left parenthesis since <" << line << ';' << column << '>' << std::endl;
+            spec.position(line, column);
+            if (!spec.accept(SpecTokens::left_paren)) {
+              diagnostics() << "error: missing expected left parenthesis at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::id(rule.goState) >> true) {
-              DEBUG_PRINTLN("go(\"" << rule.goState << "\")");
+            spec.position(line, column);
+            if (spec.name(data, length)) {
+              rule.goState = names.intern(data, length);
+              DEBUG_PRINTLN("go(\"" << names.name(rule.goState) << "\")");
             } else {
-              std::cerr << "error: missing expected target state since <" << line << ';' << column << '>' << std::endl;
+              diagnostics() << "error: missing expected target state at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_RPAREN) >> false) {
-              std::cerr << "error: missing expected right parenthesis since <" << line << ';' << column << '>' << std::endl;
+            spec.position(line, column);
+            if (!spec.accept(SpecTokens::right_paren)) {
+              diagnostics() << "error: missing expected right parenthesis at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
-          } else if (optionName == KEYWORD_KEEP) {
+            break;
+
+          case SpecTokens::kw_keep:
             if (rule.optionKeep == true) {
-              std::cerr << "warning: redefinition of option `keep` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
+              diagnostics() << "warning: redefinition of option `keep` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
             }
 
             rule.optionKeep = true;
-          } else if (optionName == KEYWORD_SKIP) {
+            break;
+
+          case SpecTokens::kw_skip:
             if (rule.optionSkip == true) {
-              std::cerr << "warning: redefinition of option `skip` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
+              diagnostics() << "warning: redefinition of option `skip` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
             }
 
             rule.optionSkip = true;
-          } else if (optionName == KEYWORD_CLEAR) {
+            break;
+
+          case SpecTokens::kw_clear:
             if (rule.optionClear == true) {
-              std::cerr << "warning: redefinition of option `clear` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
+              diagnostics() << "warning: redefinition of option `clear` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
             }
 
             rule.optionClear = true;
-          } else if (optionName == KEYWORD_TOKEN) {
+            break;
+
+          case SpecTokens::kw_token:
             if (rule.optionToken == true) {
-              std::cerr << "error: redefinition of option `token` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
+              diagnostics() << "error: redefinition of option `token` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
               return false;
             }
 
             rule.optionToken = true;
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_LPAREN) >> false) {
-              std::cerr << "error: missing expected left parenthesis since <" << line << ';' << column << '>' << std::endl;
+            spec.position(line, column);
+            if (!spec.accept(SpecTokens::left_paren)) {
+              diagnostics() << "error: missing expected left parenthesis at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::id(rule.tokenName) >> true) {
-              DEBUG_PRINTLN("token(\"" << rule.tokenName << "\")");
+            spec.position(line, column);
+            if (spec.name(data, length)) {
+              rule.tokenName = names.intern(data, length);
+              DEBUG_PRINTLN("token(\"" << names.name(rule.tokenName) << "\")");
             } else {
-              std::cerr << "error: missing expected token name since <" << line << ';' << column << '>' << std::endl;
+              diagnostics() << "error: missing expected token name at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_RPAREN) >> false) {
-              std::cerr << "error: missing expected right parenthesis since <" << line << ';' << column << '>' << std::endl;
+            spec.position(line, column);
+            if (!spec.accept(SpecTokens::right_paren)) {
+              diagnostics() << "error: missing expected right parenthesis at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
-          } else if (optionName == KEYWORD_FAILURE) {
+            break;
+
+          case SpecTokens::kw_failure:
             if (rule.optionFailure == true) {
-              std::cerr << "error: redefinition of option `failure` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
+              diagnostics() << "error: redefinition of option `failure` at <" << line << ';' << column << "> since <" << rule.line << ';' << rule.column << '>' << std::endl;
               return false;
             }
 
             rule.optionFailure = true;
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_LPAREN) >> false) {
-              std::cerr << "error: missing expected left parenthesis since <" << line << ';' << column << '>' << std::endl;
+            spec.position(line, column);
+            if (!spec.accept(SpecTokens::left_paren)) {
+              diagnostics() << "error: missing expected left parenthesis at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::str(rule.failureMessage) >> true) {
-              DEBUG_PRINTLN("failure(\"" << rule.failureMessage << "\")");
+            spec.position(line, column);
+            if (spec.string(data, length)) {
+              rule.failureMessage = names.intern(data, length);
+              DEBUG_PRINTLN("failure(\"" << names.name(rule.failureMessage) << "\")");
             } else {
-              std::cerr << "error: missing expected failure message since <" << line << ';' << column << '>' << std::endl;
+              diagnostics() << "error: missing expected failure message at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
 
-            if (src >> notation::pos(line, column) >> notation::ws() >> notation::delim(DELIM_RPAREN) >> false) {
-              std::cerr << "error: missing expected right parenthesis since <" << line << ';' << column << '>' << std::endl;
+            spec.position(line, column);
+            if (!spec.accept(SpecTokens::right_paren)) {
+              diagnostics() << "error: missing expected right parenthesis at <" << line << ';' << column << '>' << std::endl;
               return false;
             }
-          } else {
-            std::cerr << "error: unknown transition option `" << optionName << "` at <" << line << ';' << column << '>' << std::endl;
+            break;
+
+          default:
+            diagnostics() << "error: unknown transition option `" << std::string(data, length) << "` at <" << line << ';' << column << '>' << std::endl;
             return false;
           }
         }
 
-        if (src >> notation::ws() >> notation::pos(line, column) >> notation::delim(DELIM_SEMICOLON) >> false) {
-          std::cerr << "error: missing expected transition option or semicolon since <" << line << ';' << column << '>' << std::endl;
+        if (!spec.accept(SpecTokens::semicolon)) {
+          diagnostics() << "error: missing expected transition option or semicolon at <" << line << ';' << column << '>' << std::endl;
           return false;
         }
-        DEBUG_PRINTLN("transition (from state `" << stateName << "`) declaration closed at <" << line << ';' << column << '>');
+        DEBUG_PRINTLN("transition (from state `" << names.name(stateName) << "`) declaration closed at <" << line << ';' << column << '>');
       }
 
-      if (src >> notation::ws() >> notation::pos(line, column) >> notation::delim(DELIM_SEMICOLON) >> false) {
-        std::cerr << "error: missing expected semicolon before <" << line << ';' << column << '>' << std::endl;
+      if (!spec.accept(SpecTokens::semicolon)) {
+        diagnostics() << "error: missing expected semicolon before <" << line << ';' << column << '>' << std::endl;
         return false;
       }
-      DEBUG_PRINTLN("state `" << stateName << "` declaration closed at <" << line << ';' << column << '>');
+      DEBUG_PRINTLN("state `" << names.name(stateName) << "` declaration closed at <" << line << ';' << column << '>');
     }
 
-    if (src.end()) {
-      if (definition.size() > 0) {
-        return true;
-      } else {
-        std::cerr << "error: missing declaration" << std::endl;
-        return false;
-      }
-    } else {
-      std::cerr << "error: missing declaration at <" << line << ';' << column << '>' << std::endl;
+    if (spec.id() != Spec::END) {
+      diagnostics() << "error: missing declaration at <" << line << ';' << column << '>' << std::endl;
+      return false;
+    }
+    if (definition.states.empty()) {
+      diagnostics() << "error: missing declaration" << std::endl;
       return false;
     }
+
+    // Target states are looked up by any name
+    stateOfName.resize(names.count(), INVALID_ID);
+
+    // Rules of a redeclared state are scattered, they are grouped by state
+    //   keeping the order of declaration (a counting sort)
+    std::vector<State> &states = definition.states;
+    for (u32 stateId = 0, first = 0; stateId < states.size(); ++stateId) {
+      states[stateId].firstRule = first;
+      first += states[stateId].ruleCount;
+    }
+
+    bool grouped = true;
+    for (u32 ruleId = 1; ruleId < rules.size() && grouped; ++ruleId) {
+      grouped = rules[ruleId - 1].state <= rules[ruleId].state;
+    }
+    if (!grouped) {
+      std::vector<Rule> sorted(rules.size());
+      std::vector<u32> next(states.size());
+      for (u32 stateId = 0; stateId < states.size(); ++stateId) {
+        next[stateId] = states[stateId].firstRule;
+      }
+      for (u32 ruleId = 0; ruleId < rules.size(); ++ruleId) {
+        sorted[next[rules[ruleId].state]++] = rules[ruleId];
+      }
+      rules.swap(sorted);
+    }
+
+    return true;
+}
+
+
+// Diagnostics stream of the current thread, null for std::cerr
+static __thread std::ostream *threadDiagnostics = 0;
+
+std::ostream &Ways::diagnostics() {
+  return threadDiagnostics ? *threadDiagnostics : std::cerr;
+}
+
+void Ways::diagnostics(std::ostream *stream) {
+  threadDiagnostics = stream;
+}
+
+
+// Monotonic time in seconds, for statistics only
+static double now() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+
+bool Ways::translate(std::istream &in, std::ostream &out, Statistics *statistics, const Options &options) {
+  Automaton automaton;
+
+  if (false == build(in, automaton, statistics, options))
+    return false;
+
+  const double emitStart = now();
+  emit(automaton, out, options);
+  out.flush();
+
+  if (statistics) {
+    statistics->emitTime = now() - emitStart;
+    measure(automaton, *statistics, options);
+  }
+  return true;
 }
 
 
-bool Ways::translate(std::istream &in, std::ostream &out) {
-  std::map<std::string, u32> stateMap;
-  std::vector<RuleGroup> definition;
-  u32 initialStateId;
+struct Ways::RowsBuild {
+  const Definition *definition;
+  const std::vector<u32> *bounds;
+  const std::vector<u32> *classMap;
+  const std::vector<u32> *tokenOfName;
+  const std::vector<u32> *failureOfName;
+  u32 classCount;
+  Transition *transitions;
+};
+
+struct Ways::BuildJob {
+  const RowsBuild *rows;
+  u32 first, last;
+  std::stringstream diagnostics;
+  bool success;
+  pthread_t thread;
+};
 
-  if (false == parse(in, stateMap, definition, initialStateId))
+
+bool Ways::build(std::istream &in, Automaton &automaton, Statistics *statistics, const Options &options) {
+  Definition definition;
+  definition.alphabetSize = alphabetSize(options.alphabet);
+  definition.utf8 = options.alphabet == Options::AlphabetUtf8;
+
+  double phaseStart = now();
+
+  if (false == parse(in, definition))
     return false;
 
+  if (definition.utf8) {
+    lowerUtf8(definition);
+  }
+
+  const Interner &names = definition.names;
+  const std::vector<State> &states = definition.states;
+  const std::vector<Rule> &rules = definition.rules;
+  const std::vector<Keyword> &keywords = definition.keywords;
+
+  if (statistics) {
+    statistics->parseTime = now() - phaseStart;
+    phaseStart = now();
+  }
+
   std::vector<std::string> tokens;
-  std::map<std::string, u32> tokenMap;
+  std::vector<u32> tokenOfName(names.count(), INVALID_ID);
   std::vector<std::string> failureMessages;
-  std::map<std::string, u32> failureMap;
+  std::vector<u32> failureOfName(names.count(), INVALID_ID);
+
+  // Characters are partitioned by units: characters themselves for 8-bit alphabets,
+  //   elementary intervals [bounds[i], bounds[i+1]) between bounds of the ranges for wide ones
+  const bool wide = definition.alphabetSize != charsetSize;
+  std::vector<u32> bounds;
+
+  if (wide) {
+    const std::vector<Range> &ranges = definition.ranges;
+    bounds.reserve(2 * ranges.size() + 2);
+    bounds.push_back(0);
+    bounds.push_back(definition.alphabetSize);
+    for (u32 i = 0; i < ranges.size(); ++i) {
+      bounds.push_back(ranges[i].first);
+      bounds.push_back(ranges[i].last + 1);
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+  }
 
-  // Direct mapping characters into cclasses
-  u8 classMap[charsetSize];
-  u16 classUsage[charsetSize];
+  const u32 unitCount = wide ? bounds.size() - 1 : charsetSize;
+
+  // Direct mapping units into cclasses
+  std::vector<u32> classMap(unitCount, 0);
+  std::vector<u32> classUsage(unitCount + 1, 0);
+  std::vector<u32> relocations(unitCount + 1, 0);
+  std::vector<u32> relocated;     // Classes with relocations of the current rule
+  std::vector<u32> freeClasses;   // Released ids below maxClassId
+  std::vector<u32> units;
   // Class id 0 is reserved, it represents unallocated characters
-  u8 maxClassId = 0;
+  u32 maxClassId = 0;
+
+  classUsage[0] = unitCount;
+
+  for (u32 stateId = 0; stateId < states.size(); ++stateId) {
+    const State &state = states[stateId];
+    const std::string stateName = names.name(state.name);
+
+    if (state.ruleCount == 0) {
+      diagnostics() << "warning: no transitions specified (state `" << stateName << "`)" << std::endl;
+      continue;
+    }
+
+    // Default rule (with `on` option omitted) may not be defined more than one time within the same state
+    bool hasDefaultRule = false;
+
+    DEBUG_PRINTLN("new state (rules group): " << stateName);
+
+    for (u32 ruleId = state.firstRule; ruleId < state.firstRule + state.ruleCount; ++ruleId) {
+      const Rule &rule = rules[ruleId];
+
+      DEBUG_PRINTLN("new rule");
+      if (!rule.optionKeep && !rule.optionSkip && !rule.optionGo && !rule.optionFailure) {
+        diagnostics() << "error: infinite transition declared (state `" << stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
+        diagnostics() << "// at least one of the following options is needed: `keep`, `skip`, `go`, `failure`" << std::endl;
+        return false;
+      }
+
+      if (rule.optionOn) {
+        const u32 count = unitsOf(definition, bounds, rule, units);
+
+#ifdef DEBUG
+        {
+          std::stringstream stringStream;
+          for (u32 i = 0; i < count; ++i) {
+            if (wide) {
+              stringStream << '[' << bounds[units[i]] << ".." << bounds[units[i] + 1] - 1 << ']';
+            } else {
+              escape(stringStream, units[i]);
+            }
+          }
+          if (rule.onEos) {
+            stringStream << "end";
+          }
+          DEBUG_PRINTLN("on(`" << stringStream.str() << "`)");
+        }
+#endif
+
+        for (u32 i = 0; i < count; ++i) {
+          // Check if already allocated/relocated
+          const u32 oldClassId = classMap[units[i]];
+          u32 newClassId = relocations[oldClassId];
+
+          if (newClassId == 0) {
+              if (freeClasses.empty()) {
+                newClassId = ++maxClassId;
+              } else {
+                newClassId = freeClasses.back();
+                freeClasses.pop_back();
+              }
+              relocations[oldClassId] = newClassId;
+              relocated.push_back(oldClassId);
+              DEBUG_PRINTLN("allocated class: " << newClassId);
+          }
+
+          classUsage[oldClassId]--;
+          DEBUG_PRINTLN("classUsage[" << oldClassId << "]: " << classUsage[oldClassId]);
+          classUsage[newClassId]++;
+          DEBUG_PRINTLN("classUsage[" << newClassId << "]: " << classUsage[newClassId]);
+
+          if (classUsage[oldClassId] == 0) {
+            // The whole class is in the set: it keeps its id, the new one is released
+            DEBUG_PRINTLN("recycled class: " << newClassId);
+            std::swap(classUsage[oldClassId], classUsage[newClassId]);
+            relocations[oldClassId] = oldClassId;
+            if (newClassId == maxClassId) {
+              maxClassId--;
+            } else {
+              freeClasses.push_back(newClassId);
+            }
+          }
+        }
+
+        // Flush relocations
+        for (u32 i = 0; i < count; ++i) {
+          u32 &cclassId = classMap[units[i]];
+          cclassId = relocations[cclassId];
+        }
+        for (u32 i = 0; i < relocated.size(); ++i) {
+          relocations[relocated[i]] = 0;
+        }
+        relocated.clear();
+
+#ifdef DEBUG
+        {
+          for (u32 clazz = 1; clazz <= maxClassId; clazz++) {
+            if (classUsage[clazz] > 0) {
+              std::stringstream stringStream;
+              for (u32 unit = 0; unit < unitCount; unit++) {
+                if (classMap[unit] == clazz) {
+                  if (wide) {
+                    stringStream << '[' << bounds[unit] << ".." << bounds[unit + 1] - 1 << ']';
+                  } else {
+                    escape(stringStream, unit);
+                  }
+                }
+              }
+              DEBUG_PRINTLN(clazz << ": \"" << stringStream.str() << "\"");
+            }
+          }
+        }
+#endif
+      } else {
+        DEBUG_PRINTLN("used as default");
+        if (hasDefaultRule) {
+          diagnostics() << "error: redefinition of default (with `on` option omitted) transition (state `" << stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
+          return false;
+        }
+        hasDefaultRule = true;
+      }
+    }
+  }
+
+  // Released ids are holes, classes are renumbered keeping their order
+  if (!freeClasses.empty()) {
+    std::vector<u32> renumbered(maxClassId + 1, 0);
+    u32 classId = 0;
+    for (u32 clazz = 1; clazz <= maxClassId; ++clazz) {
+      if (classUsage[clazz] > 0) {
+        renumbered[clazz] = ++classId;
+      }
+    }
+    for (u32 unit = 0; unit < unitCount; ++unit) {
+      classMap[unit] = renumbered[classMap[unit]];
+    }
+    maxClassId = classId;
+  }
+
+  // Classes of characters by pages, pages of the same classes share a block
+  const u32 pageSize = Automaton::pageSize;
+  std::vector<u32> pageMap(definition.alphabetSize / pageSize, 0);
+  std::vector<u32> classBlocks;
+
+  if (wide) {
+    std::map<std::vector<u32>, u32> blockIds;
+    std::vector<u32> block(pageSize);
+    u32 unit = 0;
+
+    for (u32 page = 0; page < pageMap.size(); ++page) {
+      for (u32 i = 0, c = page * pageSize; i < pageSize; ++i, ++c) {
+        while (bounds[unit + 1] <= c) {
+          unit++;
+        }
+        block[i] = classMap[unit];
+      }
+
+      const std::pair<std::map<std::vector<u32>, u32>::iterator, bool> entry = blockIds.insert(std::make_pair(block, u32(blockIds.size())));
+      if (entry.second) {
+        classBlocks.insert(classBlocks.end(), block.begin(), block.end());
+      }
+      pageMap[page] = entry.first->second;
+    }
+    DEBUG_PRINTLN("class map: " << pageMap.size() << " page(s), " << blockIds.size() << " block(s) for " << unitCount << " unit(s)");
+  } else {
+    classBlocks = classMap;
+  }
+
+  if (statistics) {
+    statistics->partitionTime = now() - phaseStart;
+    phaseStart = now();
+  }
+
+  const u32 stateCount = states.size();
+  // All allocated classes + unallocated characters class + eos
+  const u32 classCount = maxClassId + 2;
+
+  std::vector<Transition> transitions(stateCount * classCount);
+
+  DEBUG_PRINTLN("now we have " << stateCount << " state(s) and " << classCount << " class(es)");
+
+  // Token and failure ids are assigned in declaration order before any row is built:
+  //   rows of distinct states are then independent and get the ids of a serial pass
+  for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+    const State &state = states[stateId];
+    for (u32 ruleId = state.firstRule; ruleId < state.firstRule + state.ruleCount; ++ruleId) {
+      const Rule &rule = rules[ruleId];
+
+      if (rule.optionFailure) {
+        u32 &failureId = failureOfName[rule.failureMessage];
+        if (failureId == INVALID_ID) {
+          failureMessages.push_back(names.name(rule.failureMessage));
+          failureId = failureMessages.size() - 1;
+        }
+      }
+      if (rule.optionToken) {
+        u32 &tokenId = tokenOfName[rule.tokenName];
+        if (tokenId == INVALID_ID) {
+          tokens.push_back(names.name(rule.tokenName));
+          tokenId = tokens.size() - 1;
+        }
+      }
+    }
+  }
+
+  RowsBuild rows;
+  rows.definition = &definition;
+  rows.bounds = &bounds;
+  rows.classMap = &classMap;
+  rows.tokenOfName = &tokenOfName;
+  rows.failureOfName = &failureOfName;
+  rows.classCount = classCount;
+  rows.transitions = &transitions[0];
+
+  if (false == buildRows(rows, stateCount))
+    return false;
+
+  // Keywords are resolved by a perfect hash over (base token, lexeme) pairs
+  std::vector<u32> keywordBases(keywords.size());
+  std::vector<u32> keywordTokens(keywords.size());
+  std::vector<u32> keywordTable;
+  u32 keywordSeed = 0;
+
+  if (!keywords.empty()) {
+    std::set< std::pair<u32, u32> > keywordSet;
+
+    for (u32 i = 0; i < keywords.size(); ++i) {
+      const Keyword &keyword = keywords[i];
+
+      if (tokenOfName[keyword.baseName] == INVALID_ID) {
+        diagnostics() << "error: keywords specified for unknown token `" << names.name(keyword.baseName) << "` at <" << keyword.line << ';' << keyword.column << '>' << std::endl;
+        return false;
+      }
+      keywordBases[i] = tokenOfName[keyword.baseName];
 
-  std::fill_n(classMap, charsetSize, u8(0));
-  std::fill_n(classUsage, charsetSize, u16(0));
-  classUsage[0] = charsetSize;
+      if (!keywordSet.insert(std::make_pair(keywordBases[i], keyword.lexeme)).second) {
+        diagnostics() << "error: redefinition of keyword \"" << names.name(keyword.lexeme) << "\" (token `" << names.name(keyword.baseName) << "`) at <" << keyword.line << ';' << keyword.column << '>' << std::endl;
+        return false;
+      }
+
+      u32 &tokenId = tokenOfName[keyword.tokenName];
+      if (tokenId == INVALID_ID) {
+        tokens.push_back(names.name(keyword.tokenName));
+        tokenId = tokens.size() - 1;
+      }
+      keywordTokens[i] = tokenId;
+    }
+
+    // Look for a collision-free seed, growing the table if none is found
+    const u32 SEED_ATTEMPTS = 4096;
+    u32 tableSize = 1;
+    while (tableSize < keywords.size()) {
+      tableSize *= 2;
+    }
+
+    for (bool found = false; !found; tableSize *= 2) {
+      for (u32 seed = 1; seed <= SEED_ATTEMPTS && !found; ++seed) {
+        keywordTable.assign(tableSize, INVALID_ID);
+        found = true;
+        for (u32 i = 0; i < keywords.size(); ++i) {
+          u32 &slot = keywordTable[keywordHash(seed, keywordBases[i], names.data(keywords[i].lexeme), names.length(keywords[i].lexeme), tableSize)];
+          if (slot != INVALID_ID) {
+            found = false;
+            break;
+          }
+          slot = i;
+        }
+        if (found) {
+          keywordSeed = seed;
+        }
+      }
+      if (found) {
+        break;
+      }
+    }
+
+    DEBUG_PRINTLN("keywords table: " << keywordTable.size() << " slot(s) for " << keywords.size() << " keyword(s), seed " << keywordSeed);
+  }
+
+  // Interned tokens are known by now, keywords included: a keyword is not interned unless declared so
+  std::vector<u8> internedTokens(tokens.size(), 0);
+  for (u32 i = 0; i < definition.interns.size(); ++i) {
+    const Intern &intern = definition.interns[i];
+
+    if (tokenOfName[intern.tokenName] == INVALID_ID) {
+      diagnostics() << "error: interning specified for unknown token `" << names.name(intern.tokenName) << "` at <" << intern.line << ';' << intern.column << '>' << std::endl;
+      return false;
+    }
+    internedTokens[tokenOfName[intern.tokenName]] = 1;
+  }
+
+  if (statistics) {
+    statistics->rowsTime = now() - phaseStart;
+  }
+
+  automaton.alphabetSize = definition.alphabetSize;
+  automaton.pageMap.swap(pageMap);
+  automaton.classBlocks.swap(classBlocks);
+  automaton.classCount = classCount;
+  automaton.stateCount = stateCount;
+  automaton.initialStateId = definition.initialStateId == INVALID_ID ? 0 : definition.initialStateId;
+  automaton.transitions.swap(transitions);
+  automaton.tokens.swap(tokens);
+  automaton.internedTokens.swap(internedTokens);
+  automaton.failureMessages.swap(failureMessages);
+  automaton.keywordSeed = keywordSeed;
+  automaton.keywords.resize(keywordTable.size());
+  for (u32 i = 0; i < keywordTable.size(); ++i) {
+    Automaton::KeywordSlot &slot = automaton.keywords[i];
+    if (keywordTable[i] == INVALID_ID) {
+      slot.base = slot.token = 0;
+    } else {
+      slot.lexeme = names.name(keywords[keywordTable[i]].lexeme);
+      slot.base = keywordBases[keywordTable[i]];
+      slot.token = keywordTokens[keywordTable[i]];
+    }
+  }
+
+  automaton.syncStateId = definition.syncStateId;
+  automaton.syncChars = definition.syncChars;
+  std::sort(automaton.syncChars.begin(), automaton.syncChars.end());
+  automaton.syncChars.erase(std::unique(automaton.syncChars.begin(), automaton.syncChars.end()), automaton.syncChars.end());
+
+  if (false == verifyProgress(definition, automaton))
+    return false;
+
+  if (automaton.syncStateId != INVALID_ID && !verifySync(definition, automaton)) {
+    return false;
+  }
+
+  return true;
+}
+
+
+// Whether the lexeme is empty past @transition, given whether it is @empty before
+static bool emptyPast(const Ways::Transition &transition, bool empty) {
+  const bool keeps = transition.mode == Ways::Transition::ModeKeep || transition.mode == Ways::Transition::ModeKeepPending;
+  switch (transition.action) {
+  case Ways::Transition::ActionClear:
+  case Ways::Transition::ActionToken:
+    // Once the mode applies
+    return true;
+  case Ways::Transition::ActionRecover:
+    // Before the mode applies
+    return !keeps;
+  default:
+    return empty && !keeps;
+  }
+}
+
+bool Ways::verifySync(const Definition &definition, const Automaton &automaton) {
+  const Interner &names = definition.names;
+  const std::vector<State> &states = definition.states;
+  const u32 stateCount = automaton.stateCount;
+  const u32 syncStateId = automaton.syncStateId;
+
+  // States which may be entered with a lexeme (targets of kept characters, then of
+  //   the transitions from them which do not clear it) or inside a multibyte character
+  std::vector<bool> dirty(stateCount, false);
+  std::vector<bool> inside(stateCount, false);
+  std::vector<u32> spread;
+  for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+    for (u32 classId = 0; classId < automaton.eosClass(); ++classId) {
+      const Transition &transition = automaton.transition(stateId, classId);
+      if (transition.action == Transition::ActionInvalid || transition.action == Transition::ActionFailure) {
+        continue;
+      }
+      if (transition.mode == Transition::ModePend) {
+        inside[transition.state] = true;
+      }
+      if (!emptyPast(transition, true) && !dirty[transition.state]) {
+        dirty[transition.state] = true;
+        spread.push_back(transition.state);
+      }
+    }
+  }
+  while (!spread.empty()) {
+    const u32 stateId = spread.back();
+    spread.pop_back();
+    for (u32 classId = 0; classId < automaton.eosClass(); ++classId) {
+      const Transition &transition = automaton.transition(stateId, classId);
+      if (transition.action != Transition::ActionInvalid && transition.action != Transition::ActionFailure
+          && !emptyPast(transition, false) && !dirty[transition.state]) {
+        dirty[transition.state] = true;
+        spread.push_back(transition.state);
+      }
+    }
+  }
+
+  for (u32 i = 0; i < automaton.syncChars.size(); ++i) {
+    const u32 c = automaton.syncChars[i];
+    const u32 classId = automaton.classOf(c);
+
+    for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+      // Transitions which leave the character are followed, as the lexer does
+      u32 state = stateId;
+      bool empty = !dirty[stateId];
+      bool synchronized = false;
+      for (u32 step = 0; step <= stateCount; ++step) {
+        const Transition &transition = automaton.transition(state, classId);
+        if (transition.action == Transition::ActionInvalid || transition.action == Transition::ActionFailure) {
+          // Lexing ends on it, wherever the input is split
+          synchronized = true;
+          break;
+        }
+        if (transition.mode == Transition::ModeLeavePending) {
+          // A malformed character: its bytes are lexed again as stray ones, then
+          //   this character from the state they bring to, which is checked itself
+          synchronized = true;
+          break;
+        }
+        empty = emptyPast(transition, empty);
+        state = transition.state;
+        if (transition.mode != Transition::ModeLeave) {
+          const bool whole = transition.mode == Transition::ModeKeep || transition.mode == Transition::ModeSkip;
+          synchronized = whole && empty && !inside[stateId] && state == syncStateId;
+          break;
+        }
+      }
+
+      if (!synchronized) {
+        diagnostics() << "error: character `";
+        escape(diagnostics(), u8(c));
+        diagnostics() << "` does not bring state `" << names.name(states[stateId].name) << "` to synchronizing state `"
+                      << names.name(states[syncStateId].name) << "` with no lexeme (declared at <" << definition.syncLine << ';' << definition.syncColumn << ">)" << std::endl;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
 
-  for (u32 stateId = 0; stateId < definition.size(); ++stateId) {
-    RuleGroup &group = definition[stateId];
-    std::vector<Rule> &rules = group.rules;
 
-    if (rules.empty()) {
-      std::cerr << "warning: no transitions specified (state `" << group.stateName << "`)" << std::endl;
-      continue;
+// How the transitions over a character end (see follow())
+enum Progress {
+  ProgressMade,     // The character is consumed or lexing ends on it
+  ProgressPending,  // Its next code unit is needed
+  ProgressLoop,     // They leave it forever: lexing fails on it
+  ProgressNone      // They recover from a failure and leave it forever
+};
+
+// Follows the transitions from @stateId over a character of the code units of
+//   @classes, as the lexer does
+static Progress follow(const Ways::Automaton &automaton, u32 stateId, const std::vector<u32> &classes) {
+  u32 position = 0;
+  bool recovers = false;
+
+  // Steps past the number of (state, position) pairs come back to one of them
+  const u64 limit = u64(automaton.stateCount) * classes.size();
+  for (u64 step = 0; step <= limit; ++step) {
+    const Ways::Transition &transition = automaton.transition(stateId, classes[position]);
+    if (transition.action == Ways::Transition::ActionInvalid || transition.action == Ways::Transition::ActionFailure) {
+      return ProgressMade;
     }
 
-    // Default rule (with `on` option omitted) may not be defined more than one time within the same state
-    bool hasDefaultRule = false;
-
-    DEBUG_PRINTLN("new state (rules group): " << group.stateName);
+    recovers = recovers || transition.action == Ways::Transition::ActionRecover;
+    stateId = transition.state;
+    switch (transition.mode) {
+    case Ways::Transition::ModeLeave:
+      break;
 
-    for (u32 ruleId = 0; ruleId < rules.size(); ++ruleId) {
-      Rule &rule = rules[ruleId];
+    case Ways::Transition::ModePend:
+      if (++position == classes.size()) {
+        return ProgressPending;
+      }
+      break;
 
-      bool charsUsage[charsetSize];
-      std::fill_n(charsUsage, charsetSize, false);
+    case Ways::Transition::ModeLeavePending:
+      // The pending code units are lexed again
+      position = 0;
+      break;
 
-      DEBUG_PRINTLN("new rule");
-      if (!rule.optionKeep && !rule.optionSkip && !rule.optionGo && !rule.optionFailure) {
-        std::cerr << "error: infinite transition declared (state `" << group.stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
-        std::cerr << "// at least one of the following options is needed: `keep`, `skip`, `go`, `failure`" << std::endl;
-        return false;
-      }
+    default:
+      return ProgressMade;
+    }
+  }
 
-      if (rule.optionOn) {
-        u8 relocations[charsetSize];
+  return recovers ? ProgressNone : ProgressLoop;
+}
 
-        std::fill_n(relocations, charsetSize, u8(0));
+// How lexing goes on from @stateId over the characters starting with the code
+//   units of @classes: the worst of the ways, ProgressMade if it moves on past
+// all of them; if not, @classes are the ones of the first character of the worst
+static Progress progresses(const Ways::Automaton &automaton, u32 stateId, std::vector<u32> &classes) {
+  // Characters have 4 code units at most
+  const Progress progress = follow(automaton, stateId, classes);
+  if (progress != ProgressPending || classes.size() == 4) {
+    return progress == ProgressPending ? ProgressMade : progress;
+  }
 
-#ifdef DEBUG
-        {
-          std::stringstream stringStream;
-          for (std::set<char>::iterator i = rule.onChars.begin(); i != rule.onChars.end(); i++) {
-            escape(stringStream, *i);
-          }
-          if (rule.onEos) {
-            stringStream << KEYWORD_END;
-          }
-          DEBUG_PRINTLN("on(`" << stringStream.str() << "`)");
-        }
-#endif
+  const u32 length = classes.size();
+  Progress worst = ProgressMade;
+  std::vector<u32> found;
+  for (u32 classId = 0; classId < automaton.eosClass() && worst != ProgressNone; ++classId) {
+    classes.resize(length);
+    classes.push_back(classId);
+    const Progress next = progresses(automaton, stateId, classes);
+    if (next > worst) {
+      worst = next;
+      found = classes;
+    }
+  }
 
-        for (std::set<char>::iterator i = rule.onChars.begin(); i != rule.onChars.end(); i++) {
-          u8 c = *i;
+  if (worst == ProgressMade) {
+    classes.resize(length);
+  } else {
+    classes.swap(found);
+  }
+  return worst;
+}
 
-          if (charsUsage[c]) {
-            std::cerr << "error: input character `" << *i << "` which is already in use specified for transition (state `" << group.stateName << "`) since <" << rule.line << ';' << rule.column << '>' << std::endl;
-            return false;
-          }
-          charsUsage[c] = true;
+bool Ways::verifyProgress(const Definition &definition, const Automaton &automaton) {
+  const Interner &names = definition.names;
+  const std::vector<State> &states = definition.states;
+  const u32 stateCount = automaton.stateCount;
 
-          // Check if already allocated/relocated
-          u8 oldClassId = classMap[c];
-          u8 newClassId = relocations[oldClassId];
+  // Characters start in every state but the ones entered by a leading byte
+  std::vector<bool> inside(stateCount, false);
+  for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+    for (u32 classId = 0; classId < automaton.eosClass(); ++classId) {
+      const Transition &transition = automaton.transition(stateId, classId);
+      if (transition.mode == Transition::ModePend) {
+        inside[transition.state] = true;
+      }
+    }
+  }
 
-          if (newClassId == 0) {
-              maxClassId++;
-              newClassId = maxClassId;
-              relocations[oldClassId] = newClassId;
-              DEBUG_PRINTLN("allocated class: " << u32(newClassId));
-          }
+  // The smallest code unit of every class
+  std::vector<u32> units(automaton.classCount, INVALID_ID);
+  for (u32 c = automaton.alphabetSize; c-- > 0; ) {
+    units[automaton.classOf(c)] = c;
+  }
 
-          classUsage[oldClassId]--;
-          DEBUG_PRINTLN("classUsage[" << u32(oldClassId) << "]: " << classUsage[oldClassId]);
-          classUsage[newClassId]++;
-          DEBUG_PRINTLN("classUsage[" << u32(newClassId) << "]: " << classUsage[newClassId]);
+  std::vector<u32> classes;
+  for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+    if (inside[stateId]) {
+      continue;
+    }
 
-          if (classUsage[oldClassId] == 0) {
-            DEBUG_PRINTLN("recycled class: " << u32(newClassId));
-            std::swap(classUsage[oldClassId], classUsage[newClassId]);
-            relocations[oldClassId] = oldClassId;
-            maxClassId--;
-          }
-        }
+    // A loop which recovers from no failure is an unexpected character at
+    //   runtime (see Lexer::leave()): it is told once per state
+    bool loops = false;
+    for (u32 classId = 0; classId < automaton.eosClass(); ++classId) {
+      classes.assign(1, classId);
+      const Progress progress = progresses(automaton, stateId, classes);
+      if (progress == ProgressMade || (progress == ProgressLoop && loops)) {
+        continue;
+      }
 
-        // Flush relocations
-        for (std::set<char>::iterator i = rule.onChars.begin(); i != rule.onChars.end(); i++) {
-          u8 &cclassId = classMap[u8(*i)];
-          cclassId = relocations[cclassId];
+      std::ostringstream character;
+      for (u32 i = 0; i < classes.size(); ++i) {
+        const u32 unit = units[classes[i]];
+        if (automaton.alphabetSize == charsetSize || unit < 0x80) {
+          escape(character, u8(unit));
+        } else {
+          character << "\\u{" << std::hex << unit << std::dec << '}';
         }
+      }
 
-#ifdef DEBUG
-        {
-          for (u32 clazz = 1; clazz < 256; clazz++) {
-            if (classUsage[clazz] > 0) {
-              std::stringstream stringStream;
-              for (u32 c = 0; c < 256; c++) {
-                if (classMap[c] == clazz) {
-                  escape(stringStream, c);
-                }
-              }
-              DEBUG_PRINTLN(clazz << ": \"" << stringStream.str() << "\"");
-            }
-          }
-        }
-#endif
-      } else {
-        DEBUG_PRINTLN("used as default");
-        if (hasDefaultRule) {
-          std::cerr << "error: redefinition of default (with `on` option omitted) transition (state `" << group.stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
-          return false;
-        }
-        hasDefaultRule = true;
+      if (progress == ProgressLoop) {
+        diagnostics() << "warning: transitions on `" << character.str() << "` from state `" << names.name(states[stateId].name)
+                      << "` leave the character forever, lexing fails on it" << std::endl;
+        loops = true;
+        continue;
       }
+
+      diagnostics() << "error: recovering from a failure on `" << character.str() << "` from state `" << names.name(states[stateId].name) << "` leaves the character forever" << std::endl;
+      diagnostics() << "// the recovery or a transition it leads to must consume the character: `keep`, `skip`" << std::endl;
+      return false;
     }
+
+    // The end of input, as Lexer::finish() follows it
+    u32 state = stateId;
+    bool stops = false;
+    bool recovers = false;
+    for (u32 step = 0; step <= stateCount && !stops; ++step) {
+      const Transition &transition = automaton.transition(state, automaton.eosClass());
+      stops = transition.action == Transition::ActionInvalid || transition.action == Transition::ActionFailure
+          || transition.mode != Transition::ModeLeave || transition.state == state;
+      recovers = recovers || transition.action == Transition::ActionRecover;
+      state = transition.state;
+    }
+    if (stops) {
+      continue;
+    }
+    if (recovers) {
+      diagnostics() << "error: recovering from a failure on the end of input from state `" << names.name(states[stateId].name) << "` never ends lexing" << std::endl;
+      return false;
+    }
+    diagnostics() << "warning: transitions on the end of input from state `" << names.name(states[stateId].name)
+                  << "` leave it forever, lexing fails on it" << std::endl;
   }
 
-  const u32 stateCount = stateMap.size();
-  // All allocated classes + unallocated characters class + eos
-  const u32 classCount = maxClassId + 2;
+  return true;
+}
 
-  std::vector< std::vector<Transition> > transitions(stateCount);
 
-  DEBUG_PRINTLN("now we have " << stateCount << " state(s) and " << classCount << " class(es)");
+bool Ways::buildRows(const RowsBuild &rows, u32 stateCount) {
+  const u32 jobCount = jobsFor(u64(stateCount) * rows.classCount);
 
-  for (u32 stateId = 0; stateId < stateCount; ++stateId) {
-    RuleGroup &group = definition[stateId];
-    std::vector<Rule> &rules = group.rules;
+  if (jobCount <= 1) {
+    return buildRows(rows, 0, stateCount);
+  }
+
+  // Every job builds a range of rows. The diagnostics of a job on its own thread
+  //   are held until the jobs before it are done: only the first error is printed
+  std::vector<BuildJob *> jobs(jobCount);
+  std::vector<bool> started(jobCount, false);
+  for (u32 i = 0; i < jobCount; ++i) {
+    BuildJob *job = new BuildJob();
+    job->rows = &rows;
+    job->first = u64(stateCount) * i / jobCount;
+    job->last = u64(stateCount) * (i + 1) / jobCount;
+    job->success = true;
+    jobs[i] = job;
+    started[i] = i > 0 && pthread_create(&job->thread, 0, buildRowsJob, job) == 0;
+  }
+
+  bool success = true;
+  for (u32 i = 0; i < jobCount; ++i) {
+    BuildJob &job = *jobs[i];
+    if (started[i]) {
+      pthread_join(job.thread, 0);
+    } else if (success) {
+      job.success = buildRows(rows, job.first, job.last);
+    }
+    if (success && !job.success) {
+      diagnostics() << job.diagnostics.str();
+      success = false;
+    }
+    delete jobs[i];
+  }
+  return success;
+}
 
-    transitions[stateId].resize(classCount);
+void *Ways::buildRowsJob(void *job) {
+  BuildJob &build = *static_cast<BuildJob *>(job);
+  diagnostics(&build.diagnostics);
+  build.success = buildRows(*build.rows, build.first, build.last);
+  return 0;
+}
+
+bool Ways::buildRows(const RowsBuild &rows, u32 first, u32 last) {
+  const Definition &definition = *rows.definition;
+  const Interner &names = definition.names;
+  const std::vector<State> &states = definition.states;
+  const std::vector<Rule> &rules = definition.rules;
+  const std::vector<u32> &bounds = *rows.bounds;
+  const std::vector<u32> &classMap = *rows.classMap;
+  const std::vector<u32> &tokenOfName = *rows.tokenOfName;
+  const std::vector<u32> &failureOfName = *rows.failureOfName;
+  const u32 classCount = rows.classCount;
+  std::vector<u32> units;
+
+  for (u32 stateId = first; stateId < last; ++stateId) {
+    const State &state = states[stateId];
+    const std::string stateName = names.name(state.name);
+    Transition *row = rows.transitions + u64(stateId) * classCount;
 
     Transition defaultTransition;
     bool hasDefaultRule = false;
-    std::set<u8> defaultClasses;
-
     // Universal set for now
-    for (u32 clazz = 0; clazz < classCount; ++clazz) {
-      defaultClasses.insert(clazz);
-    }
+    std::vector<bool> defaultClasses(classCount, true);
 
-    for (u32 ruleId = 0; ruleId < rules.size(); ++ruleId) {
-      Rule &rule = rules[ruleId];
+    for (u32 ruleId = state.firstRule; ruleId < state.firstRule + state.ruleCount; ++ruleId) {
+      const Rule &rule = rules[ruleId];
       Transition transition;
 
       // Default values
@@ -447,30 +2062,21 @@ bool Ways::translate(std::istream &in, std::ostream &out) {
       transition.mode = Transition::ModeLeave;
       transition.state = stateId;
 
+      // A failure going to another state is recovered from there
       if (rule.optionFailure) {
-        transition.action = Transition::ActionFailure;
-        if (rule.optionGo || rule.optionClear || rule.optionToken) {
-          std::cerr << "error: option `failure` is incompatible with `go`, `clear` and `token` options of transition (state `" << group.stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
+        transition.action = rule.optionGo ? Transition::ActionRecover : Transition::ActionFailure;
+        if (rule.optionClear || rule.optionToken) {
+          diagnostics() << "error: option `failure` is incompatible with `clear` and `token` options of transition (state `" << stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
           return false;
         }
 
-        u32 failureId;
-        if (failureMap.count(rule.failureMessage)) {
-          failureId = failureMap[rule.failureMessage];
-        } else {
-          failureMessages.push_back(rule.failureMessage);
-          failureId = failureMessages.size() - 1;
-          failureMap[rule.failureMessage] = failureId;
-        }
-        transition.arg = failureId;
+        transition.arg = failureOfName[rule.failureMessage];
       }
 
       if (rule.optionGo) {
-        u32 nextStateId;
-        if (stateMap.count(rule.goState)) {
-          nextStateId = stateMap[rule.goState];
-        } else {
-          std::cerr << "error: unknown next state `" << rule.goState << "` transition at <" << rule.line << ";" << rule.column << ">" << std::endl;
+        const u32 nextStateId = definition.stateOfName[rule.goState];
+        if (nextStateId == INVALID_ID) {
+          diagnostics() << "error: unknown next state `" << names.name(rule.goState) << "` transition at <" << rule.line << ";" << rule.column << ">" << std::endl;
           return false;
         }
         transition.state = nextStateId;
@@ -479,19 +2085,11 @@ bool Ways::translate(std::istream &in, std::ostream &out) {
       if (rule.optionToken) {
         transition.action = Transition::ActionToken;
         if (rule.optionClear) {
-          std::cerr << "error: option `token` is incompatible with `clear` option of transition (state `" << group.stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
+          diagnostics() << "error: option `token` is incompatible with `clear` option of transition (state `" << stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
           return false;
         }
 
-        u32 tokenId;
-        if (tokenMap.count(rule.tokenName)) {
-          tokenId = tokenMap[rule.tokenName];
-        } else {
-          tokens.push_back(rule.tokenName);
-          tokenId = tokens.size() - 1;
-          tokenMap[rule.tokenName] = tokenId;
-        }
-        transition.arg = tokenId;
+        transition.arg = tokenOfName[rule.tokenName];
       }
 
       if (rule.optionClear) {
@@ -501,7 +2099,7 @@ bool Ways::translate(std::istream &in, std::ostream &out) {
       if (rule.optionKeep) {
         transition.mode = Transition::ModeKeep;
         if (rule.optionSkip) {
-          std::cerr << "error: option `keep` is incompatible with `keep` option of transition (state `" << group.stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
+          diagnostics() << "error: option `keep` is incompatible with `keep` option of transition (state `" << stateName << "`) at <" << rule.line << ';' << rule.column << '>' << std::endl;
           return false;
         }
       }
@@ -510,18 +2108,25 @@ bool Ways::translate(std::istream &in, std::ostream &out) {
         transition.mode = Transition::ModeSkip;
       }
 
+      // Modes apply to whole characters: leading bytes are pending until the last one
+      if (rule.sequence == Rule::SequencePrefix) {
+        transition.mode = Transition::ModePend;
+      } else if (rule.sequence == Rule::SequenceLast) {
+        static const u8 pendingModes[] = {Transition::ModeLeavePending, Transition::ModeKeepPending, Transition::ModeSkipPending};
+        transition.mode = pendingModes[transition.mode];
+      }
+
       if (rule.optionOn) {
-        std::set<u8> classes;
-        for (std::set<char>::const_iterator i = rule.onChars.begin(); i != rule.onChars.end(); i++) {
-          classes.insert(classMap[u8(*i)]);
+        const u32 count = unitsOf(definition, bounds, rule, units);
+        for (u32 i = 0; i < count; ++i) {
+          const u32 clazz = classMap[units[i]];
+          row[clazz] = transition;
+          defaultClasses[clazz] = false;
         }
         if (rule.onEos) {
           // Eos is represented by a class with maximum id
-          classes.insert(classCount-1);
-        }
-        for (std::set<u8>::const_iterator i = classes.begin(); i != classes.end(); i++) {
-          transitions[stateId][*i] = transition;
-          defaultClasses.erase(*i);
+          row[classCount-1] = transition;
+          defaultClasses[classCount-1] = false;
         }
       } else {
         hasDefaultRule = true;
@@ -530,106 +2135,694 @@ bool Ways::translate(std::istream &in, std::ostream &out) {
     }
 
     if (hasDefaultRule) {
-      for (std::set<u8>::const_iterator i = defaultClasses.begin(); i != defaultClasses.end(); i++) {
-        transitions[stateId][*i] = defaultTransition;
+      for (u32 clazz = 0; clazz < classCount; ++clazz) {
+        if (defaultClasses[clazz]) {
+          row[clazz] = defaultTransition;
+        }
       }
     }
   }
 
-  out << "#include <elib/aliases.hpp>" << std::endl << std::endl;
+  return true;
+}
 
-  out << "namespace Ways {" << std::endl;
-  out << "  using namespace elib::aliases;" << std::endl << std::endl;
 
-  out << "  const u32 charsetSize = " << charsetSize << ';' << std::endl;
-  out << "  const u32 classCount = " << classCount << ';' << std::endl;
-  out << "  const u32 stateCount = " << stateCount << ';' << std::endl;
-  if (initialStateId == INVALID_ID) {
-    initialStateId = 0;
+void Ways::emit(const Automaton &automaton, std::ostream &stream, const Options &options) {
+  output::Buffer out(&stream);
+  const u32 classCount = automaton.classCount;
+  const u32 stateCount = automaton.stateCount;
+  const bool wide = automaton.alphabetSize != charsetSize;
+  const u32 pageSize = Automaton::pageSize;
+  const u32 pageCount = automaton.pageMap.size();
+  const u32 blockCount = automaton.classBlocks.size() / pageSize;
+  // Eos is never mapped
+  const char *const classType = unitType(classCount - 2);
+  const std::vector<std::string> &tokens = automaton.tokens;
+  const std::vector<std::string> &failureMessages = automaton.failureMessages;
+  const std::vector<Automaton::KeywordSlot> &keywords = automaton.keywords;
+
+  const bool interning = std::find(automaton.internedTokens.begin(), automaton.internedTokens.end(), 1) != automaton.internedTokens.end();
+  const bool sync = automaton.syncStateId != INVALID_ID;
+  // A single synchronizing byte is looked for by memchr()
+  const bool syncByte = sync && !wide && automaton.syncChars.size() == 1;
+  const char *const charType = !wide ? "char" : automaton.alphabetSize > 0x10000 ? "unsigned int" : "u16";
+
+  out << "#include <elib/aliases.hpp>" << '\n' << '\n';
+  if (!keywords.empty() || syncByte) {
+    out << "#include <cstring>" << '\n' << '\n';
   }
-  out << "  const u32 initialStateId = " << initialStateId << ';' << std::endl << std::endl;
 
-  out << "  const u8 classMap[charsetSize] = {";
-  for (u32 i = 0; i < charsetSize; ++i) {
-    const u8 clazz = classMap[i];
-    if (i % 16 == 0) {
-      out << std::endl << "    ";
+  out << "namespace " << options.name << " {" << '\n';
+  out << "  using namespace elib::aliases;" << '\n' << '\n';
+
+  if (wide) {
+    out << "  const u32 alphabetSize = " << automaton.alphabetSize << ';' << '\n';
+  } else {
+    out << "  const u32 charsetSize = " << charsetSize << ';' << '\n';
+  }
+  out << "  const u32 classCount = " << classCount << ';' << '\n';
+  out << "  const u32 stateCount = " << stateCount << ';' << '\n';
+  out << "  const u32 initialStateId = " << automaton.initialStateId << ';' << '\n' << '\n';
+
+  if (wide) {
+    out << "  const u32 pageSize = " << pageSize << ';' << '\n';
+    out << "  const u32 pageCount = " << pageCount << ';' << '\n';
+    out << "  const u32 blockCount = " << blockCount << ';' << '\n' << '\n';
+
+    out << "  // Class of character c is classBlocks[pageMap[c / pageSize]][c % pageSize]" << '\n';
+    out << "  const " << unitType(blockCount - 1) << " pageMap[pageCount] = {";
+    emitMap(&automaton.pageMap[0], pageCount, "    ", out);
+    out << '\n' << "  };" << '\n' << '\n';
+
+    out << "  const " << classType << " classBlocks[blockCount][pageSize] = {" << '\n';
+    for (u32 block = 0; block < blockCount; ++block) {
+      out << "    {";
+      emitMap(&automaton.classBlocks[block * pageSize], pageSize, "      ", out);
+      out << '\n' << (block == blockCount-1 ? "    }" : "    },") << '\n';
     }
-    if (clazz < 100) {
-      if (clazz < 10) {
-        out << "   ";
-      } else {
-        out << "  ";
-      }
-    } else {
-      out << ' ';
+    out << "  };" << '\n' << '\n';
+
+    out << "  inline u32 classOf(" << (automaton.alphabetSize > 0x10000 ? "u32" : "u16") << " c) {" << '\n';
+    if (automaton.alphabetSize > 0x10000) {
+      out << "    if (c >= alphabetSize) {" << '\n'
+          << "      return 0;" << '\n'
+          << "    }" << '\n';
     }
-    out << u32(clazz) << (i == charsetSize-1 ? "" : ",");
+    out << "    return classBlocks[pageMap[c / pageSize]][c % pageSize];" << '\n'
+        << "  }" << '\n' << '\n';
+  } else {
+    out << "  const " << classType << " classMap[charsetSize] = {";
+    emitMap(&automaton.classBlocks[0], charsetSize, "    ", out);
+    out << '\n' << "  };" << '\n' << '\n';
   }
-  out << std::endl << "  };" << std::endl << std::endl;
 
   if (!failureMessages.empty()) {
-    out << "  const char *failureMessages[] = {" << std::endl;
+    out << "  const char *failureMessages[] = {" << '\n';
     for (u32 i = 0; i < failureMessages.size(); ++i) {
-      std::string &message = failureMessages[i];
+      const std::string &message = failureMessages[i];
       out << "    \"";
       for (u32 j = 0; j < message.length(); ++j) {
         escape(out, message[j]);
       }
-      out << "\"" << (i == failureMessages.size()-1 ? "" : ",") << std::endl;
+      out << "\"" << (i == failureMessages.size()-1 ? "" : ",") << '\n';
     }
-    out << "  };" << std::endl << std::endl;
+    out << "  };" << '\n' << '\n';
   }
 
   if (!tokens.empty()) {
-    out << "  struct Tokens {" << std::endl;
-    out << "    enum {" << std::endl;
+    out << "  struct Tokens {" << '\n';
+    out << "    enum {" << '\n';
     for (u32 i = 0; i < tokens.size(); ++i) {
-      out << "      " << tokens[i] << (i == tokens.size()-1 ? "" : ",") << std::endl;
-    }
-    out << "    };" << std::endl << "  };" << std::endl << std::endl;
-  }
-
-  out << "  struct Transition {" << std::endl
-      << "  public:" << std::endl
-      << "    enum {" << std::endl
-      << "      ActionInvalid," << std::endl
-      << "      ActionContinue," << std::endl
-      << "      ActionClear," << std::endl
-      << "      ActionToken," << std::endl
-      << "      ActionFailure" << std::endl
-      << "    };" << std::endl
-      << std::endl
-      << "    enum {" << std::endl
-      << "      ModeLeave," << std::endl
-      << "      ModeKeep," << std::endl
-      << "      ModeSkip" << std::endl
-      << "    };" << std::endl
-      << "  " << std::endl
-      << "  public:" << std::endl
-      << "    Transition() : state(0), action(ActionInvalid), mode(ModeLeave), arg(0) {}" << std::endl
-      << std::endl
-      << "  public:" << std::endl
-      << "    u32 state;" << std::endl
-      << "    u8 action;" << std::endl
-      << "    u8 mode;" << std::endl
-      << "    u32 arg;" << std::endl
-      << "  };" << std::endl << std::endl;
-
-  out << "  const Transition transitions[][] = {" << std::endl;
-  for (u32 stateId = 0; stateId < stateCount; ++stateId) {
-    std::vector<Transition> &row = transitions[stateId];
+      out << "      " << tokens[i] << (i == tokens.size()-1 ? "" : ",") << '\n';
+    }
+    out << "    };" << '\n' << "  };" << '\n' << '\n';
+  }
+
+  if (interning) {
+    out << "  // Whether lexemes of a token are interned as they are lexed (see runtime/symbols.hpp)" << '\n'
+        << "  const u8 internedTokens[" << tokens.size() << "] = {";
+    for (u32 i = 0; i < tokens.size(); ++i) {
+      out << (i % 16 == 0 ? "\n    " : " ") << u32(automaton.internedTokens[i]) << (i == tokens.size()-1 ? "" : ",");
+    }
+    out << '\n' << "  };" << '\n' << '\n';
+  }
+
+  if (!keywords.empty()) {
+    out << "  const u32 keywordSeed = " << automaton.keywordSeed << ';' << '\n';
+    out << "  const u32 keywordTableSize = " << keywords.size() << ';' << '\n' << '\n';
+
+    out << "  struct Keyword {" << '\n'
+        << "    const char *lexeme;" << '\n'
+        << "    u32 length;" << '\n'
+        << "    u32 base;" << '\n'
+        << "    u32 token;" << '\n'
+        << "  };" << '\n' << '\n';
+
+    out << "  const Keyword keywords[keywordTableSize] = {" << '\n';
+    for (u32 i = 0; i < keywords.size(); ++i) {
+      const Automaton::KeywordSlot &slot = keywords[i];
+      out << "    ";
+      if (slot.lexeme.empty()) {
+        out << "{0, 0, 0, 0}";
+      } else {
+        out << "{\"";
+        for (u32 j = 0; j < slot.lexeme.length(); ++j) {
+          escape(out, slot.lexeme[j]);
+        }
+        out << "\", " << slot.lexeme.length() << ", " << slot.base << ", " << slot.token << '}';
+      }
+      out << (i == keywords.size()-1 ? "" : ",") << '\n';
+    }
+    out << "  };" << '\n' << '\n';
+
+    out << "  inline u32 keywordHash(u32 base, const char *lexeme, u32 length) {" << '\n'
+        << "    u32 hash = (keywordSeed ^ (base * 0x9e3779b1UL)) & 0xffffffffUL;" << '\n'
+        << "    for (u32 i = 0; i < length; ++i) {" << '\n'
+        << "      hash = ((hash ^ u8(lexeme[i])) * 16777619UL) & 0xffffffffUL;" << '\n'
+        << "    }" << '\n'
+        << "    return (hash ^ (hash >> 15)) & (keywordTableSize - 1);" << '\n'
+        << "  }" << '\n' << '\n';
+
+    out << "  // Returns the keyword token matching the lexeme of @token or @token itself" << '\n'
+        << "  inline u32 keyword(u32 token, const char *lexeme, u32 length) {" << '\n'
+        << "    const Keyword &entry = keywords[keywordHash(token, lexeme, length)];" << '\n'
+        << "    if (entry.lexeme != 0 && entry.base == token && entry.length == length && std::memcmp(entry.lexeme, lexeme, length) == 0) {" << '\n'
+        << "      return entry.token;" << '\n'
+        << "    }" << '\n'
+        << "    return token;" << '\n'
+        << "  }" << '\n' << '\n';
+  }
+
+  if (sync) {
+    out << "  // Past a synchronizing character lexing is in syncStateId with no lexeme, whatever" << '\n'
+        << "  //   the input before: input may be split past them and the parts lexed independently" << '\n'
+        << "  const u32 syncStateId = " << automaton.syncStateId << ';' << '\n' << '\n';
+
+    out << "  // Returns the character past the next synchronizing one of [data, end), end if there is none" << '\n'
+        << "  inline const " << charType << " *sync(const " << charType << " *data, const " << charType << " *end) {" << '\n';
+    if (syncByte) {
+      out << "    const void *found = std::memchr(data, " << automaton.syncChars[0] << ", end - data);" << '\n'
+          << "    return found ? static_cast<const char *>(found) + 1 : end;" << '\n';
+    } else {
+      out << "    for (; data < end; ++data) {" << '\n'
+          << "      if (";
+      for (u32 i = 0; i < automaton.syncChars.size(); ++i) {
+        out << (i == 0 ? "" : " || ") << "*data == " << automaton.syncChars[i];
+      }
+      out << ") {" << '\n'
+          << "        return data + 1;" << '\n'
+          << "      }" << '\n'
+          << "    }" << '\n'
+          << "    return end;" << '\n';
+    }
+    out << "  }" << '\n' << '\n';
+  }
+
+  out << "  struct Transition {" << '\n'
+      << "  public:" << '\n'
+      << "    enum {" << '\n'
+      << "      ActionInvalid," << '\n'
+      << "      ActionContinue," << '\n'
+      << "      ActionClear," << '\n'
+      << "      ActionToken," << '\n'
+      << "      ActionFailure," << '\n'
+      << "      ActionRecover" << '\n'
+      << "    };" << '\n'
+      << '\n'
+      << "    enum {" << '\n'
+      << "      ModeLeave," << '\n'
+      << "      ModeKeep," << '\n'
+      << "      ModeSkip," << '\n'
+      << "      ModePend," << '\n'
+      << "      ModeKeepPending," << '\n'
+      << "      ModeSkipPending," << '\n'
+      << "      ModeLeavePending" << '\n'
+      << "    };" << '\n'
+      << "  " << '\n'
+      << "  public:" << '\n'
+      << "    u32 state;" << '\n'
+      << "    u8 action;" << '\n'
+      << "    u8 mode;" << '\n'
+      << "    u32 arg;" << '\n'
+      << "  };" << '\n' << '\n';
+
+  std::vector<u32> cells;
+  std::vector<Transition> cold;
+  if (options.layout == Options::LayoutSplit) {
+    split(automaton, cells, cold);
+
+    out << "  // Cell: state << 2 | mode of a transition which continues keeping or skipping," << '\n'
+        << "  //   index << 2 of the transition in coldTransitions for the rest" << '\n'
+        << "  const " << unitType(*std::max_element(cells.begin(), cells.end())) << " cells[stateCount][classCount] = {" << '\n';
+    for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+      out << "    {";
+      emitMap(&cells[u64(stateId) * classCount], classCount, "      ", out);
+      out << '\n' << (stateId == stateCount-1 ? "    }" : "    },") << '\n';
+    }
+    out << "  };" << '\n' << '\n';
+
+    out << "  const u32 coldCount = " << cold.size() << ';' << '\n'
+        << "  const Transition coldTransitions[coldCount] = {";
+    for (u32 i = 0; i < cold.size(); ++i) {
+      const Transition &tr = cold[i];
+      out << (i % 4 == 0 ? "\n    " : " ") << '{' << tr.state << ", " << u32(tr.action) << ", " << u32(tr.mode) << ", " << tr.arg << (i == cold.size()-1 ? "}" : "},");
+    }
+    out << '\n' << "  };" << '\n' << '\n';
+  } else {
+    out << "  const Transition transitions[stateCount][classCount] = {" << '\n';
+    emitRows(automaton, out);
+    out << "  };" << '\n' << '\n';
+  }
+
+  bool stride2 = options.stride == 2;
+  if (stride2 && pairsSize(automaton) > options.strideLimit) {
+    diagnostics() << "warning: table of pairs takes " << pairsSize(automaton) << " bytes, over the limit of "
+                  << options.strideLimit << ", lexing a character per step" << std::endl;
+    stride2 = false;
+  }
+  if (stride2) {
+    const u32 width = classCount - 1;
+    std::vector<u32> pairs;
+    Ways::pairs(automaton, pairs);
+
+    out << "  // Pair of classes (a, b) is at a * pairWidth + b, its cell is" << '\n'
+        << "  //   state << 4 | first mode << 2 | second mode if both characters continue" << '\n'
+        << "  // keeping or skipping, zero otherwise" << '\n'
+        << "  const u32 pairWidth = " << width << ';' << '\n'
+        << "  const " << unitType((stateCount - 1) << 4 | 0xf) << " pairs[stateCount][pairWidth * pairWidth] = {" << '\n';
+    for (u32 stateId = 0; stateId < stateCount; ++stateId) {
+      out << "    {";
+      emitMap(&pairs[u64(stateId) * width * width], width * width, "      ", out);
+      out << '\n' << (stateId == stateCount-1 ? "    }" : "    },") << '\n';
+    }
+    out << "  };" << '\n' << '\n';
+  }
+
+  out << "  // Automaton interface of the runtime lexer (see runtime/lexer.hpp)" << '\n'
+      << "  struct Automaton {" << '\n'
+      << "    typedef " << options.name << "::Transition Transition;" << '\n';
+  if (!wide) {
+    out << "    typedef char Char;" << '\n';
+  } else if (automaton.alphabetSize > 0x10000) {
+    out << "    typedef unsigned int Char;  // UTF-32 code unit" << '\n';
+  } else {
+    out << "    typedef u16 Char;  // UTF-16 code unit" << '\n';
+  }
+  out << '\n'
+      << "    u32 initialState() const { return initialStateId; }" << '\n'
+      << "    u32 eosClass() const { return classCount - 1; }" << '\n';
+  if (wide) {
+    out << "    u32 classOf(Char c) const { return " << options.name << "::classOf(c); }" << '\n';
+  } else {
+    out << "    u32 classOf(u8 c) const { return classMap[c]; }" << '\n';
+  }
+  if (options.layout == Options::LayoutSplit) {
+    // The hot transition is made up in registers: the lexer binds it to a reference
+    out << "    Transition transition(u32 stateId, u32 classId) const {" << '\n'
+        << "      const u32 cell = cells[stateId][classId];" << '\n'
+        << "      if (cell & 3) {" << '\n'
+        << "        const Transition hot = {cell >> 2, Transition::ActionContinue, u8(cell & 3), 0};" << '\n'
+        << "        return hot;" << '\n'
+        << "      }" << '\n'
+        << "      return coldTransitions[cell >> 2];" << '\n'
+        << "    }" << '\n';
+  } else {
+    out << "    const Transition &transition(u32 stateId, u32 classId) const { return transitions[stateId][classId]; }" << '\n';
+  }
+  if (stride2) {
+    out << '\n'
+        << "    // Stride-2 interface" << '\n'
+        << "    typedef u32 Pair;" << '\n'
+        << "    u32 pair(u32 stateId, u32 firstClass, u32 secondClass) const { return pairs[stateId][firstClass * pairWidth + secondClass]; }" << '\n'
+        << '\n';
+  }
+  if (keywords.empty()) {
+    out << "    u32 keyword(u32 token, const Char *, u32) const { return token; }" << '\n';
+  } else {
+    out << "    u32 keyword(u32 token, const char *lexeme, u32 length) const { return " << options.name << "::keyword(token, lexeme, length); }" << '\n';
+  }
+  if (interning) {
+    out << '\n'
+        << "    // Interning interface" << '\n'
+        << "    typedef u32 Interned;" << '\n'
+        << "    bool interned(u32 tokenId) const { return internedTokens[tokenId] != 0; }" << '\n';
+  }
+  if (sync) {
+    out << '\n'
+        << "    // Sync interface" << '\n'
+        << "    typedef u32 Sync;" << '\n'
+        << "    u32 syncState() const { return syncStateId; }" << '\n'
+        << "    const Char *sync(const Char *data, const Char *end) const { return " << options.name << "::sync(data, end); }" << '\n';
+  }
+  out << "  };" << '\n';
+  out << "}  // namespace" << '\n';
+
+  out.flush();
+}
+
+
+void Ways::emitMap(const u32 *values, u32 count, const char *indent, output::Buffer &out) {
+  for (u32 i = 0; i < count; ++i) {
+    const u32 value = values[i];
+    if (i % 16 == 0) {
+      out << '\n' << indent;
+    }
+    if (value < 100) {
+      if (value < 10) {
+        out << "   ";
+      } else {
+        out << "  ";
+      }
+    } else {
+      out << ' ';
+    }
+    out << value << (i == count-1 ? "" : ",");
+  }
+}
+
+const char *Ways::unitType(u32 maximum) {
+  return maximum <= 0xff ? "u8" : maximum <= 0xffff ? "u16" : "u32";
+}
+
+u32 Ways::unitSize(u32 maximum) {
+  return maximum <= 0xff ? 1 : maximum <= 0xffff ? 2 : 4;
+}
+
+
+struct Ways::RowsJob {
+  const Automaton *automaton;
+  u32 first, last;
+  output::Buffer buffer;
+  pthread_t thread;
+};
+
+u32 Ways::jobsFor(u64 cellCount) {
+  // Below that many cells per thread the work is cheaper than threads
+  const u64 CELLS_PER_JOB = 1 << 16;
+
+  const long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+  return std::min<u64>(cpuCount > 0 ? cpuCount : 1, cellCount / CELLS_PER_JOB);
+}
+
+void Ways::emitRows(const Automaton &automaton, output::Buffer &out) {
+  const u32 stateCount = automaton.stateCount;
+  const u32 jobCount = jobsFor(u64(stateCount) * automaton.classCount);
+
+  if (jobCount <= 1) {
+    emitRows(automaton, 0, stateCount, out);
+    return;
+  }
+
+  // Every job formats a range of rows into its own buffer, the buffers are concatenated in order
+  std::vector<RowsJob *> jobs(jobCount);
+  std::vector<bool> started(jobCount, false);
+  for (u32 i = 0; i < jobCount; ++i) {
+    RowsJob *job = new RowsJob();
+    job->automaton = &automaton;
+    job->first = u64(stateCount) * i / jobCount;
+    job->last = u64(stateCount) * (i + 1) / jobCount;
+    jobs[i] = job;
+    started[i] = i > 0 && pthread_create(&job->thread, 0, emitRowsJob, job) == 0;
+  }
+
+  for (u32 i = 0; i < jobCount; ++i) {
+    if (started[i]) {
+      pthread_join(jobs[i]->thread, 0);
+    } else {
+      emitRowsJob(jobs[i]);
+    }
+    out.append(jobs[i]->buffer);
+    delete jobs[i];
+  }
+}
+
+void *Ways::emitRowsJob(void *job) {
+  RowsJob &rows = *static_cast<RowsJob *>(job);
+  emitRows(*rows.automaton, rows.first, rows.last, rows.buffer);
+  return 0;
+}
+
+void Ways::emitRows(const Automaton &automaton, u32 first, u32 last, output::Buffer &out) {
+  const u32 classCount = automaton.classCount;
+  const u32 stateCount = automaton.stateCount;
+
+  for (u32 stateId = first; stateId < last; ++stateId) {
     out << "    {";
     for (u32 classId = 0; classId < classCount; ++classId) {
-      Transition &tr = row[classId];
-      out << "{" << tr.state << ", " << u32(tr.action) << ", " << u32(tr.mode) << ", " << tr.arg << (classId == classCount-1 ? "}" : "}, ");
+      const Transition &tr = automaton.transition(stateId, classId);
+      out << '{' << tr.state << ", " << u32(tr.action) << ", " << u32(tr.mode) << ", " << tr.arg << (classId == classCount-1 ? "}" : "}, ");
     }
-    out << (stateId == stateCount-1 ? "}" : "},") << std::endl;
+    out << (stateId == stateCount-1 ? "}" : "},") << '\n';
   }
-  out << "  };" << std::endl;
-  out << "}  // namespace" << std::endl;
+}
 
-  return true;
+void Ways::split(const Automaton &automaton, std::vector<u32> &cells, std::vector<Transition> &cold) {
+  // Cold transitions are few distinct ones: failures, tokens, leaving ones
+  std::map<std::vector<u32>, u32> coldIds;
+  std::vector<u32> key(4);
+
+  cells.resize(u64(automaton.stateCount) * automaton.classCount);
+  cold.clear();
+  for (u64 i = 0; i < cells.size(); ++i) {
+    const Transition &transition = automaton.transitions[i];
+    if (transition.action == Transition::ActionContinue && transition.arg == 0
+        && (transition.mode == Transition::ModeKeep || transition.mode == Transition::ModeSkip)) {
+      cells[i] = transition.state << 2 | transition.mode;
+      continue;
+    }
+
+    key[0] = transition.state;
+    key[1] = transition.action;
+    key[2] = transition.mode;
+    key[3] = transition.arg;
+    std::map<std::vector<u32>, u32>::iterator found = coldIds.find(key);
+    if (found == coldIds.end()) {
+      found = coldIds.insert(std::make_pair(key, u32(cold.size()))).first;
+      cold.push_back(transition);
+    }
+    cells[i] = found->second << 2;
+  }
+}
+
+void Ways::pairs(const Automaton &automaton, std::vector<u32> &pairs) {
+  const u32 width = automaton.classCount - 1;
+
+  pairs.resize(u64(automaton.stateCount) * width * width);
+  for (u32 stateId = 0; stateId < automaton.stateCount; ++stateId) {
+    for (u32 first = 0; first < width; ++first) {
+      const Transition &head = automaton.transition(stateId, first);
+      const bool plain = head.action == Transition::ActionContinue && head.arg == 0
+          && (head.mode == Transition::ModeKeep || head.mode == Transition::ModeSkip);
+      u32 *row = &pairs[(u64(stateId) * width + first) * width];
+
+      for (u32 second = 0; second < width; ++second) {
+        const Transition &tail = automaton.transition(head.state, second);
+        if (plain && tail.action == Transition::ActionContinue && tail.arg == 0
+            && (tail.mode == Transition::ModeKeep || tail.mode == Transition::ModeSkip)) {
+          row[second] = tail.state << 4 | u32(head.mode) << 2 | tail.mode;
+        } else {
+          row[second] = 0;
+        }
+      }
+    }
+  }
+}
+
+u64 Ways::pairsSize(const Automaton &automaton) {
+  const u64 width = automaton.classCount - 1;
+  return automaton.stateCount * width * width * unitSize((automaton.stateCount - 1) << 4 | 0xf);
+}
+
+void Ways::measure(const Automaton &automaton, Statistics &statistics, const Options &options) {
+  // Mirror of the emitted `struct Keyword`
+  struct EmittedKeyword {
+    const char *lexeme;
+    u32 length;
+    u32 base;
+    u32 token;
+  };
+
+  statistics.stateCount = automaton.stateCount;
+  statistics.classCount = automaton.classCount;
+  statistics.tokenCount = automaton.tokens.size();
+  statistics.failureCount = automaton.failureMessages.size();
+  statistics.keywordCount = 0;
+  statistics.tables.clear();
+
+  Statistics::Table table;
+
+  if (automaton.alphabetSize == charsetSize) {
+    table.name = "classMap";
+    table.encoding = "flat";
+    table.bytes = charsetSize * unitSize(automaton.classCount - 2);
+    statistics.tables.push_back(table);
+  } else {
+    const u32 blockCount = automaton.classBlocks.size() / Automaton::pageSize;
+
+    table.name = "pageMap";
+    table.encoding = "flat";
+    table.bytes = automaton.pageMap.size() * unitSize(blockCount - 1);
+    statistics.tables.push_back(table);
+
+    table.name = "classBlocks";
+    table.encoding = "paged";
+    table.bytes = automaton.classBlocks.size() * unitSize(automaton.classCount - 2);
+    statistics.tables.push_back(table);
+  }
+
+  if (options.layout == Options::LayoutSplit) {
+    std::vector<u32> cells;
+    std::vector<Transition> cold;
+    split(automaton, cells, cold);
+
+    table.name = "cells";
+    table.encoding = "hot";
+    table.bytes = cells.size() * unitSize(*std::max_element(cells.begin(), cells.end()));
+    statistics.tables.push_back(table);
+
+    table.name = "coldTransitions";
+    table.encoding = "struct";
+    table.bytes = cold.size() * sizeof(Transition);
+    statistics.tables.push_back(table);
+  } else {
+    table.name = "transitions";
+    table.encoding = "struct";
+    table.bytes = u64(automaton.stateCount) * automaton.classCount * sizeof(Transition);
+    statistics.tables.push_back(table);
+  }
+
+  if (options.stride == 2 && pairsSize(automaton) <= options.strideLimit) {
+    table.name = "pairs";
+    table.encoding = "stride2";
+    table.bytes = pairsSize(automaton);
+    statistics.tables.push_back(table);
+  }
+
+  if (!automaton.failureMessages.empty()) {
+    table.name = "failureMessages";
+    table.encoding = "strings";
+    table.bytes = automaton.failureMessages.size() * sizeof(const char *);
+    for (u32 i = 0; i < automaton.failureMessages.size(); ++i) {
+      table.bytes += automaton.failureMessages[i].length() + 1;
+    }
+    statistics.tables.push_back(table);
+  }
+
+  if (!automaton.keywords.empty()) {
+    table.name = "keywords";
+    table.encoding = "perfectHash";
+    table.bytes = automaton.keywords.size() * sizeof(EmittedKeyword);
+    for (u32 i = 0; i < automaton.keywords.size(); ++i) {
+      if (!automaton.keywords[i].lexeme.empty()) {
+        table.bytes += automaton.keywords[i].lexeme.length() + 1;
+        statistics.keywordCount++;
+      }
+    }
+    statistics.tables.push_back(table);
+  }
+
+  if (std::find(automaton.internedTokens.begin(), automaton.internedTokens.end(), 1) != automaton.internedTokens.end()) {
+    table.name = "internedTokens";
+    table.encoding = "flat";
+    table.bytes = automaton.internedTokens.size();
+    statistics.tables.push_back(table);
+  }
+}
+
+std::string Ways::Options::key() const {
+  static const char *alphabets[] = {"8", "16", "32", "utf8"};
+  static const char *layouts[] = {"flat", "split"};
+  std::ostringstream stream;
+  stream << "name=" << name << ";alphabet=" << alphabets[alphabet] << ";layout=" << layouts[layout]
+         << ";stride=" << stride << ";strideLimit=" << strideLimit << ';';
+  return stream.str();
+}
+
+
+void Ways::Statistics::print(std::ostream &out) const {
+  out << "{" << std::endl
+      << "  \"time\": {" << std::endl
+      << "    \"parse\": " << parseTime << ',' << std::endl
+      << "    \"partition\": " << partitionTime << ',' << std::endl
+      << "    \"rows\": " << rowsTime << ',' << std::endl
+      << "    \"emit\": " << emitTime << ',' << std::endl
+      << "    \"total\": " << (parseTime + partitionTime + rowsTime + emitTime) << std::endl
+      << "  }," << std::endl
+      << "  \"states\": " << stateCount << ',' << std::endl
+      << "  \"classes\": " << classCount << ',' << std::endl
+      << "  \"tokens\": " << tokenCount << ',' << std::endl
+      << "  \"failures\": " << failureCount << ',' << std::endl
+      << "  \"keywords\": " << keywordCount << ',' << std::endl
+      << "  \"tables\": [";
+  for (u32 i = 0; i < tables.size(); ++i) {
+    const Table &table = tables[i];
+    out << (i == 0 ? "" : ",") << std::endl
+        << "    {\"name\": \"" << table.name << "\", \"encoding\": \"" << table.encoding << "\", \"bytes\": " << table.bytes << '}';
+  }
+  out << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+u32 Ways::Automaton::keyword(u32 token, const char *lexeme, u32 length) const {
+  if (keywords.empty()) {
+    return token;
+  }
+
+  const KeywordSlot &slot = keywords[keywordHash(keywordSeed, token, lexeme, length, keywords.size())];
+  if (!slot.lexeme.empty() && slot.base == token && slot.lexeme.compare(0, std::string::npos, lexeme, length) == 0) {
+    return slot.token;
+  }
+  return token;
+}
+
+const char *Ways::Automaton::sync(const char *data, const char *end) const {
+  if (syncChars.size() == 1) {
+    const void *found = std::memchr(data, char(syncChars[0]), end - data);
+    return found ? static_cast<const char *>(found) + 1 : end;
+  }
+
+  for (; data < end; ++data) {
+    if (std::find(syncChars.begin(), syncChars.end(), u32(u8(*data))) != syncChars.end()) {
+      return data + 1;
+    }
+  }
+  return end;
+}
+
+u32 Ways::keywordHash(u32 seed, u32 base, const char *lexeme, u32 length, u32 tableSize) {
+  u32 hash = (seed ^ (base * 0x9e3779b1UL)) & 0xffffffffUL;
+  for (u32 i = 0; i < length; ++i) {
+    hash = ((hash ^ u8(lexeme[i])) * 16777619UL) & 0xffffffffUL;
+  }
+  return (hash ^ (hash >> 15)) & (tableSize - 1);
+}
+
+void Ways::escape(output::Buffer &out, u8 c) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  const u8 SPECIAL_CHARACTER_MAX = 31;
+
+  if (c <= SPECIAL_CHARACTER_MAX) {
+    switch ((char)c) {
+    case '\0':
+      out << "\\0";
+      break;
+
+    case '\n':
+      out << "\\n";
+      break;
+
+    case '\t':
+      out << "\\t";
+      break;
+
+    case '\r':
+      out << "\\r";
+      break;
+
+    default:
+      out << "\\x";
+      if (c >= 16) {
+        out << HEX_DIGITS[c >> 4];
+      }
+      out << HEX_DIGITS[c & 15];
+    }
+  } else {
+    switch ((char) c) {
+    case '\\':
+      out << "\\\\";
+      break;
+
+    case '\'':
+      out << "\\\'";
+      break;
+
+    case '\"':
+      out << "\\\"";
+      break;
+
+    default:
+      out << char(c);
+    }
+  }
 }
 
 void Ways::escape(std::ostream &out, u8 c) {
@@ -11,18 +11,280 @@ using namespace elib::aliases;
 #include <vector>
 #include <string>
 
-#define DEBUG
+#include "runtime/symbols.hpp"
+
+namespace output {
+  class Buffer;
+}
 
 class Ways {
+public:
+    struct Transition {
+    public:
+      // A failure with a next state is recovered from (see runtime/lexer.hpp)
+      enum {
+        ActionInvalid,
+        ActionContinue,
+        ActionClear,
+        ActionToken,
+        ActionFailure,
+        ActionRecover
+      };
+
+      // Pending modes handle multibyte characters of UTF-8 alphabets (see runtime/lexer.hpp)
+      enum {
+        ModeLeave,
+        ModeKeep,
+        ModeSkip,
+        ModePend,
+        ModeKeepPending,
+        ModeSkipPending,
+        ModeLeavePending
+      };
+
+    public:
+      Transition() : state(0), action(ActionInvalid), mode(ModeLeave), arg(0) {}
+
+    public:
+      u32 state;
+      u8 action;
+      u8 mode;
+      u32 arg;
+    };
+
+    /**
+     * Lexer tables built from a specification (see build()).
+     *   It also provides the automaton interface expected by the runtime
+     * lexer (see runtime/lexer.hpp).
+    **/
+    struct Automaton {
+    public:
+      typedef Ways::Transition Transition;
+      typedef char Char;
+
+      struct KeywordSlot {
+        std::string lexeme;  // Empty for a free slot
+        u32 base;
+        u32 token;
+      };
+
+    public:
+      Automaton() : alphabetSize(0), classCount(0), stateCount(0), initialStateId(0), syncStateId(INVALID_ID), keywordSeed(0) {}
+
+      u32 initialState() const { return initialStateId; }
+      u32 eosClass() const { return classCount - 1; }
+      u32 classOf(u32 c) const {
+        // The first page always has the first block
+        if (c < pageSize) {
+          return classBlocks[c];
+        }
+        return c < alphabetSize ? classBlocks[pageMap[c / pageSize]*pageSize + c % pageSize] : 0;
+      }
+      const Transition &transition(u32 stateId, u32 classId) const { return transitions[stateId*classCount + classId]; }
+
+      /**
+       * Returns the keyword token matching the lexeme of @token or @token itself
+      **/
+      u32 keyword(u32 token, const char *lexeme, u32 length) const;
+
+      // Sync interface (see lexer::HasSync), INVALID_ID for no synchronizing state
+      typedef u32 Sync;
+      u32 syncState() const { return syncStateId; }
+
+      /**
+       * Returns the character past the next synchronizing one of [@data, @end),
+       *   @end if there is none
+      **/
+      const char *sync(const char *data, const char *end) const;
+
+      // Interning interface (see lexer::HasInterned)
+      typedef u32 Interned;
+      bool interned(u32 tokenId) const { return internedTokens[tokenId] != 0; }
+
+    public:
+      static const u32 pageSize = 256;
+
+      /**
+       * Classes of characters are mapped by pages of @pageSize characters:
+       *   class of @c is classBlocks[pageMap[c / pageSize]*pageSize + c % pageSize].
+       * Pages of the same classes share a block, so the map grows with
+       * the number of class boundaries rather than with the alphabet.
+      **/
+      u32 alphabetSize;
+      std::vector<u32> pageMap;
+      std::vector<u32> classBlocks;
+
+      u32 classCount;
+      u32 stateCount;
+      u32 initialStateId;
+      std::vector<Transition> transitions;  // stateCount x classCount
+
+      /**
+       * Past any of @syncChars lexing is in @syncStateId with no lexeme,
+       *   whatever the input before (verified by build()): input may be
+       * split past them and the parts lexed independently.
+      **/
+      u32 syncStateId;
+      std::vector<u32> syncChars;
+
+      std::vector<std::string> tokens;
+      std::vector<u8> internedTokens;  // Per token: whether its lexemes are interned (`intern`)
+      std::vector<std::string> failureMessages;
+      u32 keywordSeed;
+      std::vector<KeywordSlot> keywords;
+    };
+
+    /**
+     * Options of the emitted tables (see emit())
+    **/
+    struct Options {
+    public:
+      /**
+       * Code units the lexer reads: bytes, UTF-16 or UTF-32 code units,
+       *   or bytes of UTF-8 text matched by whole characters.
+       * The specification is UTF-8 text unless the alphabet is 8-bit.
+      **/
+      enum Alphabet {
+        Alphabet8,
+        Alphabet16,
+        Alphabet32,
+        AlphabetUtf8
+      };
+
+      /**
+       * Layout of the emitted transitions: a table of whole transitions,
+       *   or a table of cells of the next state only with the rest of the
+       * uncommon transitions in a side table (see split()).
+      **/
+      enum Layout {
+        LayoutFlat,
+        LayoutSplit
+      };
+
+    public:
+      static const u64 DEFAULT_STRIDE_LIMIT = 1 << 20;
+
+    public:
+      Options() : name("Ways"), alphabet(Alphabet8), layout(LayoutFlat), stride(1), strideLimit(DEFAULT_STRIDE_LIMIT) {}
+
+      /**
+       * Canonical text of the options, part of the cache key (see Cache)
+      **/
+      std::string key() const;
+
+    public:
+      std::string name;  // Namespace of the tables
+      Alphabet alphabet;
+      Layout layout;
+      u32 stride;       // Characters per step of the lexer: 1 or 2 (see pairs())
+      u64 strideLimit;  // Size of the table of pairs in bytes, stride 1 beyond it
+    };
+
+    /**
+     * Generation report (see translate()): time of each phase in seconds,
+     *   sizes of the automaton and footprint of the emitted tables.
+    **/
+    struct Statistics {
+    public:
+      struct Table {
+        std::string name;
+        std::string encoding;
+        u64 bytes;
+      };
+
+    public:
+      Statistics() : parseTime(0), partitionTime(0), rowsTime(0), emitTime(0), stateCount(0), classCount(0), tokenCount(0), failureCount(0), keywordCount(0) {}
+
+      /**
+       * Prints out the report as a JSON object
+      **/
+      void print(std::ostream &out) const;
+
+    public:
+      double parseTime;
+      double partitionTime;
+      double rowsTime;
+      double emitTime;
+
+      u32 stateCount;
+      u32 classCount;
+      u32 tokenCount;
+      u32 failureCount;
+      u32 keywordCount;
+
+      std::vector<Table> tables;
+    };
+
 private:
+    struct Range;
     struct Rule;
-    struct RuleGroup;
-    struct Transition;
-    struct CClassGenerationNode;
+    struct State;
+    struct Keyword;
+    struct Definition;
+
+    /**
+     * Interns names of a specification (states, tokens, failure messages and
+     *   keyword lexemes) into dense ids, in order of the first occurrence:
+     * the symbol table of the runtime (see runtime/symbols.hpp).
+    **/
+    class Interner : public symbols::Table<char> {
+    public:
+      std::string name(u32 id) const { return std::string(data(id), length(id)); }
+    };
+
+    /**
+     * Set of input characters, a bit per character
+    **/
+    struct CharSet {
+    public:
+      CharSet() { clear(); }
+
+      void clear() { bits[0] = bits[1] = bits[2] = bits[3] = 0; }
+      void insert(u8 c) { bits[c >> 6] |= u64(1) << (c & 63); }
+      bool contains(u8 c) const { return (bits[c >> 6] >> (c & 63)) & 1; }
+      bool empty() const { return (bits[0] | bits[1] | bits[2] | bits[3]) == 0; }
+
+      /**
+       * Stores the characters of the set into @chars.
+       * Returns the number of characters.
+      **/
+      u32 list(u8 *chars) const;
 
+    public:
+      u64 bits[4];
+    };
+
+    /**
+     * Characters [first, last] of a wide alphabet
+    **/
+    struct Range {
+      u32 first;
+      u32 last;
+    };
+
+    /**
+     * Names (@goState, @tokenName, @failureMessage) are ids of Definition::names.
+     *   Rules of the byte states a UTF-8 set is lowered to (see lowerUtf8())
+     * read the bytes of a multibyte character (@sequence).
+     *   Characters of 8-bit alphabets are in @onChars, the ones of wide alphabets
+     * are Definition::ranges[firstRange, firstRange + rangeCount).
+    **/
     struct Rule {
+    public:
+      enum {
+        SequenceNone,
+        SequencePrefix,  // A leading byte of a character
+        SequenceLast     // The last byte of a character
+      };
+
     public:
       Rule() :
+      state(INVALID_ID),
+      goState(INVALID_ID),
+      tokenName(INVALID_ID),
+      failureMessage(INVALID_ID),
+      line(0),
+      column(0),
       optionOn(false),
       optionGo(false),
       optionClear(false),
@@ -30,9 +292,19 @@ private:
       optionSkip(false),
       optionToken(false),
       optionFailure(false),
-      onEos(false) {}
+      onEos(false),
+      firstRange(0),
+      rangeCount(0),
+      sequence(SequenceNone) {}
 
     public:
+      u32 state;  // Owning state
+      u32 goState;
+      u32 tokenName;
+      u32 failureMessage;
+
+      u32 line, column;
+
       bool optionOn;
       bool optionGo;
       bool optionClear;
@@ -42,93 +314,257 @@ private:
       bool optionFailure;
 
       bool onEos;
-      std::set<char> onChars;
-      std::string goState;
-      std::string tokenName;
-      std::string failureMessage;
+      CharSet onChars;
+      u32 firstRange;
+      u32 rangeCount;
+      u8 sequence;
+    };
 
-      u32 line, column;
+    /**
+     * Rules of a state are Definition::rules[firstRule, firstRule + ruleCount)
+    **/
+    struct State {
+      u32 name;  // For diagnosis only
+      u32 firstRule;
+      u32 ruleCount;
     };
 
-    struct RuleGroup {
-      std::vector<Rule> rules;
-      std::string stateName;  // For diagnosis only
+    /**
+     * A keyword refines the token @baseName: whenever the lexeme of that token
+     *   equals @lexeme the token @tokenName is produced instead.
+     * All three are ids of Definition::names.
+    **/
+    struct Keyword {
+      u32 baseName;
+      u32 lexeme;
+      u32 tokenName;
+
+      u32 line, column;
     };
 
-    struct Transition {
-    public:
-      enum {
-        ActionInvalid,
-        ActionContinue,
-        ActionClear,
-        ActionToken,
-        ActionFailure
-      };
+    /**
+     * Lexemes of the token @tokenName (an id of Definition::names) are
+     *   interned as they are lexed: the runtime lexer hands a symbol id
+     * along with the token (see runtime/symbols.hpp).
+    **/
+    struct Intern {
+      u32 tokenName;
 
-      enum {
-        ModeLeave,
-        ModeKeep,
-        ModeSkip
-      };
+      u32 line, column;
+    };
 
+    /**
+     * Intermediate representation of a specification
+    **/
+    struct Definition {
     public:
-      Transition() : state(0), action(ActionInvalid), mode(ModeLeave), arg(0) {}
+      Definition() : alphabetSize(charsetSize), utf8(false), initialStateId(INVALID_ID), syncStateId(INVALID_ID), syncLine(0), syncColumn(0) {}
 
     public:
-      u32 state;
-      u8 action;
-      u8 mode;
-      u32 arg;
+      u32 alphabetSize;
+      bool utf8;  // Characters are code points read as UTF-8 bytes
+      Interner names;
+      std::vector<State> states;
+      std::vector<u32> stateOfName;  // Name id -> state id, INVALID_ID unless declared
+      std::vector<Rule> rules;       // Grouped by state
+      std::vector<Range> ranges;
+      std::vector<Keyword> keywords;
+      std::vector<Intern> interns;
+      u32 initialStateId;
+      u32 syncStateId;              // Declared by `sync(...)`, INVALID_ID if none
+      std::vector<u32> syncChars;
+      u32 syncLine, syncColumn;
     };
 
     /**
-     * Currently the 8-bit encodings are only supported.
-     *   That allows to achieve a high performance using static
-     * tables (maps) with constant complexity for most of operations.
+     * Size of 8-bit alphabets: their tables are flat maps with constant
+     *   complexity for most of operations.
      *
-     * The size of tables is equal to input charset size (i.e. 256).
+     * Wide alphabets are mapped by pages (see Automaton::pageMap).
     **/
     static const u32 charsetSize;
 
+    /**
+     * Returns the number of characters of @alphabet
+    **/
+    static u32 alphabetSize(Options::Alphabet alphabet);
+
     static const u32 INVALID_ID;
 
-    static const char *KEYWORD_INITIAL;
-    static const char *KEYWORD_STATE;
-    static const char *KEYWORD_ON;
-    static const char *KEYWORD_GO;
-    static const char *KEYWORD_KEEP;
-    static const char *KEYWORD_SKIP;
-    static const char *KEYWORD_CLEAR;
-    static const char *KEYWORD_TOKEN;
-    static const char *KEYWORD_FAILURE;
-    static const char *KEYWORD_TRANSITION;
-    static const char *KEYWORD_END;
-
-    static const char DELIM_COLON;
-    static const char DELIM_SEMICOLON;
-    static const char DELIM_LPAREN;
-    static const char DELIM_RPAREN;
 public:
+    /**
+     * Version of the generator, part of the cache key (see Cache):
+     *   it must change whenever the emitted tables do.
+    **/
+    static const char *VERSION;
+
     /**
      * Parses @in stream and generates (prints to @out) transition tables
      *  for fsm (lexer).
      * Returns true if succeeds or false if fails.
     **/
-    static bool translate(std::istream &in, std::ostream &out);
+    static bool translate(std::istream &in, std::ostream &out, Statistics *statistics = 0, const Options &options = Options());
+
+    /**
+     * Parses @in stream and builds tables of @automaton for the alphabet of @options.
+     *   Phase timings are stored into @statistics unless it is null.
+     * Returns true if succeeds or false if fails.
+    **/
+    static bool build(std::istream &in, Automaton &automaton, Statistics *statistics = 0, const Options &options = Options());
+
+    /**
+     * Stream the errors and warnings of the calling thread are printed to.
+     *   It is std::cerr unless another one is set (null restores std::cerr).
+    **/
+    static std::ostream &diagnostics();
+    static void diagnostics(std::ostream *stream);
+
+    /**
+     * Stores sizes of @automaton and footprint of its tables (in the layout
+     *   of @options) into @statistics
+    **/
+    static void measure(const Automaton &automaton, Statistics &statistics, const Options &options = Options());
+
+    /**
+     * Splits the transitions of @automaton into hot @cells (one per state and
+     *   class, row by row) and @cold transitions: a cell is
+     *     state << 2 | mode for a transition which continues with ModeKeep
+     *       or ModeSkip (the mode is never zero),
+     *     index << 2 of its transition in @cold for the rest (equal cold
+     *       transitions are stored once).
+     * So the common path of the lexer loads a narrow cell only.
+    **/
+    static void split(const Automaton &automaton, std::vector<u32> &cells, std::vector<Transition> &cold);
+
+    /**
+     * Builds the table of pairs of characters of @automaton: @pairs has
+     *   (classCount - 1)^2 cells per state (eos is never a part of a pair),
+     * the cell of classes (a, b) of a state is at a * (classCount - 1) + b:
+     *   state << 4 | first mode << 2 | second mode if both transitions
+     *     continue keeping or skipping,
+     *   zero otherwise, the lexer takes a character at a time then.
+    **/
+    static void pairs(const Automaton &automaton, std::vector<u32> &pairs);
+
+    /**
+     * Returns the size in bytes of the table of pairs of @automaton
+    **/
+    static u64 pairsSize(const Automaton &automaton);
+
+    /**
+     * Prints out (to @out) tables of @automaton as a C++ source.
+    **/
+    static void emit(const Automaton &automaton, std::ostream &out, const Options &options = Options());
 
 private:
     /**
      * Parses @in stream and builds intermediate representation
-     * @state_map: state name -> corresponding id in @definition vector
-     * <convention>@definition must be empty</convention>
-     * <convention>@stateMap must be empty</convention>
+     *   for the alphabet of Definition::alphabetSize characters.
+     * <convention>@definition must be empty but the alphabet</convention>
+    **/
+    static bool parse(std::istream &in, Definition &definition);
+
+    /**
+     * Stores the units (see build()) of the characters of @rule into @units:
+     *   characters of 8-bit alphabets, ids of the elementary intervals between
+     * @bounds of wide ones.
+     * Returns the number of units.
+    **/
+    static u32 unitsOf(const Definition &definition, const std::vector<u32> &bounds, const Rule &rule, std::vector<u32> &units);
+
+    class Utf8Lowering;
+
+    /**
+     * Turns code point sets of a UTF-8 @definition into byte sets:
+     *   every state reads the leading byte of a multibyte character and goes
+     * to a byte state reading the rest, its last byte takes the rule matching
+     * the whole character. Byte states of the same transitions are shared.
+     * Bytes which may not lead a character are characters of no set: the
+     * default rule takes them. So does it the bytes of a malformed sequence
+     * (cut by a byte which may not continue it, the end of input included):
+     * they are lexed again one by one as such bytes (ModeLeavePending), the
+     * leading one from a state of the default rule only.
+    **/
+    static void lowerUtf8(Definition &definition);
+
+    /**
+     * Hash function of the keywords table, the generated lexer uses exactly the same one.
+     * @tableSize must be a power of two
     **/
-    static bool parse(std::istream &in, std::map<std::string, u32> &stateMap, std::vector<RuleGroup> &definition, u32 &initialStateId);
+    static u32 keywordHash(u32 seed, u32 base, const char *lexeme, u32 length, u32 tableSize);
+
+    /**
+     * Checks that the synchronizing characters of @definition bring every
+     *   state of @automaton to the synchronizing state with no lexeme: the
+     * transitions on such a character, followed while they leave it, either
+     * fail or consume it into that state with the lexeme empty (cleared by
+     * a token, `clear` or a recovered failure, or empty already because no
+     * kept character reaches the state they started from).
+     * Returns true if they do or false (with an error) if they do not.
+    **/
+    static bool verifySync(const Definition &definition, const Automaton &automaton);
+
+    /**
+     * Checks that lexing moves on past the failures recovered from: from
+     *   every state of @automaton a character starts in, the transitions on
+     * any character, followed while they leave it (the bytes pending of a
+     * multibyte one are lexed again), either fail or consume it if they
+     * recover from a failure on the way, and so on for the end of input.
+     * A recovery which leaves its character must lead to a state which
+     * consumes it: `failure(...) go(S)` from S loops, `skip failure(...) go(S)`
+     * does not. Other transitions which leave a character forever are only
+     * warned about: lexing fails on it, as on a character with no transition.
+     * Returns true if they do or false (with an error) if they do not.
+    **/
+    static bool verifyProgress(const Definition &definition, const Automaton &automaton);
+
+    struct RowsBuild;
+    struct BuildJob;
+
+    /**
+     * Builds the rows of @stateCount states into RowsBuild::transitions,
+     *   large tables are built by several threads.
+     * <convention>Token and failure ids of all the rules must be assigned</convention>
+     * Returns true if succeeds or false if fails (the first error is printed).
+    **/
+    static bool buildRows(const RowsBuild &rows, u32 stateCount);
+    static bool buildRows(const RowsBuild &rows, u32 first, u32 last);
+    static void *buildRowsJob(void *job);
+
+    /**
+     * Returns the number of threads sharing work over @cellCount cells of
+     *   the transitions table (at most one per processor)
+    **/
+    static u32 jobsFor(u64 cellCount);
+
+    struct RowsJob;
+
+    /**
+     * Prints out rows of the transitions table,
+     *   large tables are formatted by several threads.
+    **/
+    static void emitRows(const Automaton &automaton, output::Buffer &out);
+
+    /**
+     * Prints out @count @values of a class map by lines of 16,
+     *   every line is started by @indent.
+    **/
+    static void emitMap(const u32 *values, u32 count, const char *indent, output::Buffer &out);
+
+    /**
+     * Type (and size in bytes) of the emitted tables holding values up to @maximum
+    **/
+    static const char *unitType(u32 maximum);
+    static u32 unitSize(u32 maximum);
+
+    static void emitRows(const Automaton &automaton, u32 first, u32 last, output::Buffer &out);
+    static void *emitRowsJob(void *job);
 
     /**
      * Prints out a human-readable representation of the specified character
     **/
     static void escape(std::ostream &out, u8 c);
+    static void escape(output::Buffer &out, u8 c);
 };
 
 #endif // WAYS_HPP
@@ -5,5 +5,16 @@ CONFIG -= qt
 
 INCLUDEPATH += ./include
 
-SOURCES += main.cpp notation.cpp ways.cpp
-HEADERS += notation.hpp ways.hpp
+SOURCES += batch.cpp cache.cpp jit.cpp main.cpp output.cpp ways.cpp runtime/location.cpp
+HEADERS += batch.hpp cache.hpp jit.hpp output.hpp ways.hpp bootstrap/tables.hpp runtime/lexer.hpp runtime/location.hpp runtime/symbols.hpp
+LIBS += -lpthread
+
+# Verbose diagnostics of the generator (DEBUG_PRINTLN)
+CONFIG(debug, debug|release): DEFINES += DEBUG
+
+# The front end lexes specifications with tables generated by ways itself:
+#   `make bootstrap` regenerates them after a change of bootstrap/ways.fa
+bootstrap.commands = $$OUT_PWD/$$TARGET --namespace=bootstrap < $$PWD/bootstrap/ways.fa > $$PWD/bootstrap/tables.hpp.new && mv $$PWD/bootstrap/tables.hpp.new $$PWD/bootstrap/tables.hpp
+bootstrap.depends = $$OUT_PWD/$$TARGET
+QMAKE_EXTRA_TARGETS += bootstrap
+OTHER_FILES += bootstrap/ways.fa